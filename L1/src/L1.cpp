@@ -1,4 +1,4 @@
-#include <sstream> 
+#include <string_view> 
 
 #include <L1.h>
 #include <code_generator.h> 
@@ -12,71 +12,96 @@ Register::Register (RegisterID r)
   return ;
 }
 
+RegisterID Register::id() const {
+  return ID; 
+}
+
 Number::Number (int64_t n)
   : number {n}{
     return ; 
   }
+
+Register* canonical_register(RegisterID r) {
+  static Register registers[] = {rdi, rsi, rdx, rcx, r8, r9, rax, rbx, rbp, r10, r11, r12, r13, r14, r15, rsp}; 
+  return &registers[r]; 
+}
+
+Number* make_number(Arena &arena, int64_t n) {
+  static const int64_t smallMin = -16, smallMax = 1024; 
+  static std::vector<Number> smallNumbers = [] {
+    std::vector<Number> v; 
+    for (int64_t i = smallMin; i <= smallMax; i++) {
+      v.emplace_back(i); 
+    }
+    return v; 
+  }(); 
+  if (n >= smallMin && n <= smallMax) {
+    return &smallNumbers[n - smallMin]; 
+  }
+  return arena.make<Number>(n); 
+}
   
 int64_t Number::value() const {
   return number; 
 }
 
-Label::Label (const std::string &s)
+Label::Label (Symbol s)
   : label {s} {
     return; 
   }
 
-Func::Func (const std::string &s)
+Func::Func (Symbol s)
   : function_label {s} {
     return; 
   }
 
+Symbol Label::symbol() const {
+  return label; 
+}
+
+Symbol Func::symbol() const {
+  return function_label; 
+}
+
 Memory::Memory (Register *r, Number *n)
   : reg {r}, offset {n} {
     return; 
   }
 
-std::string Register::emit (const EmitOptions& options) const {
-  std::ostringstream s; 
-  std::string reg = options.eightBitRegister ? eightBitReg_assembly_from_register(ID) : options.indirectRegCall ? indirect_call_reg_assembly_from_register(ID) : assembly_from_register(ID); 
-  s << reg; 
-  return s.str(); 
+Register* Memory::getReg() const {
+  return reg; 
 }
 
-std::string Number::emit(const EmitOptions& options) const {
-  std::string nString = std::to_string(number); 
-  std::ostringstream s; 
-  s << "$" << nString;
-  return s.str(); 
+Number* Memory::getOffset() const {
+  return offset; 
 }
 
-std::string Label::emit(const EmitOptions& options) const {
-  std::string lname = label.substr(1); 
-  std::ostringstream s; 
-  std::string prefix = options.memoryStoredLabel ? "$_" : "_"; 
-  s << prefix << lname;
-  return s.str(); 
+std::string Item::emit(const EmitOptions& options) const {
+  Emitter e; 
+  emit_to(e, options); 
+  return e.str(); 
 }
 
-std::string Func::emit(const EmitOptions& options) const {
-  std::string fname = function_label.substr(1); 
-  std::ostringstream s; 
-  if (options.functionCall) {
-    s << "_" << fname; 
-  } else {
-    s << "$_" << fname; 
-  }
-  return s.str(); 
+void Register::emit_to(Emitter& e, const EmitOptions& options) const {
+  e << (options.eightBitRegister ? eightBitReg_assembly_from_register(ID) : options.indirectRegCall ? indirect_call_reg_assembly_from_register(ID) : assembly_from_register(ID)); 
 }
 
-std::string Memory::emit(const EmitOptions& options) const {
-  
-  std::string offsetString = offset->emit().substr(1);
-  std::string regString = reg->emit();
-  
-  std::ostringstream s; 
-  s << offsetString << "(" << regString << ")"; 
-  return s.str(); 
+void Number::emit_to(Emitter& e, const EmitOptions& options) const {
+  e << '$' << number; 
+}
+
+void Label::emit_to(Emitter& e, const EmitOptions& options) const {
+  std::string_view lname = symbol_name(label); 
+  e << (options.memoryStoredLabel ? "$_" : "_") << lname.substr(1); 
+}
+
+void Func::emit_to(Emitter& e, const EmitOptions& options) const {
+  std::string_view fname = symbol_name(function_label); 
+  e << (options.functionCall ? "_" : "$_") << fname.substr(1); 
+}
+
+void Memory::emit_to(Emitter& e, const EmitOptions& options) const {
+  e << offset->value() << '(' << emitted(reg) << ')'; 
 }
 
 
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace L1 {
+
+  /*
+   * Bump-pointer allocator that owns a program's IR. Nodes are never freed
+   * one at a time; everything goes away with the arena. Only types with a
+   * non-trivial destructor (e.g. Function) are remembered for teardown.
+   */
+  class Arena {
+    public:
+      Arena() = default;
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+      Arena(Arena&& other) noexcept;
+      Arena& operator=(Arena&& other) noexcept;
+      ~Arena();
+
+      template <typename T, typename... Args>
+      T* make(Args&&... args) {
+        T* t = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+          finalizers.emplace_back(t, [](void* o) { static_cast<T*>(o)->~T(); });
+        }
+        return t;
+      }
+
+      void* allocate(size_t size, size_t align);
+
+    private:
+      void release();
+
+      std::vector<std::unique_ptr<char[]>> blocks;
+      char* cur = nullptr;
+      char* end = nullptr;
+      std::vector<std::pair<void*, void (*)(void*)>> finalizers;
+  };
+}
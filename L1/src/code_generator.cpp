@@ -1,15 +1,20 @@
+#include <atomic>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <thread>
 
 #include <code_generator.h>
+#include <elf_writer.h>
 #include <helper.h> 
+#include <trace.h>
 
 using namespace std;
 
 namespace L1{
-  CodeGenBehavior::CodeGenBehavior(std::ofstream &out)
-    : out (out) {
+  CodeGenBehavior::CodeGenBehavior(std::ostream &stream, size_t jobs)
+    : stream (stream), jobs (jobs) {
       return; 
     }
  
@@ -23,7 +28,7 @@ namespace L1{
     out << "  pushq %r13\n";
     out << "  pushq %r14\n";
     out << "  pushq %r15\n";
-    out << "  call _" << p.entryPointLabel.substr(1) << "\n";
+    out << "  call _" << std::string_view(p.entryPointLabel).substr(1) << "\n";
     out << "  popq %r15\n";
     out << "  popq %r14\n";
     out << "  popq %r13\n";
@@ -31,13 +36,47 @@ namespace L1{
     out << "  popq %rbp\n";
     out << "  popq %rbx\n";
     out << "  retq\n"; 
-    for (Function* f: p.functions) {
-      f->accept(*this);
+    if (jobs <= 1) {
+      for (Function* f: p.functions) {
+        f->accept(*this);
+        if (out.size() >= flushSize) {
+          flush(); 
+        }
+      }
+      flush(); 
+      return; 
+    }
+
+    // Functions only read the IR, so workers can emit them into separate buffers
+    // that are written out in program order afterwards
+    std::vector<std::ostringstream> buffers(p.functions.size()); 
+    std::atomic<size_t> next{0}; 
+    std::vector<std::thread> workers; 
+    for (size_t t = 0; t < jobs; t++) {
+      workers.emplace_back([&] {
+        for (size_t f = next++; f < buffers.size(); f = next++) {
+          CodeGenBehavior b(buffers[f]); 
+          p.functions[f]->accept(b); 
+          b.flush(); 
+        }
+      }); 
+    }
+    for (auto& w : workers) {
+      w.join(); 
+    }
+    flush(); 
+    for (auto& buffer : buffers) {
+      stream << buffer.str(); 
     }
   }
 
+  void CodeGenBehavior::flush() {
+    out.flush(stream); 
+  }
+
   void CodeGenBehavior::act(Function& f) {
-    out << "_" << f.name.substr(1) << ":" << "\n"; 
+    L1_TRACE(TraceCodegen, "codegen " << f.name << ": " << f.instructions.size() << " instructions"); 
+    out << "_" << std::string_view(f.name).substr(1) << ":" << "\n"; 
     int64_t localsSpace = f.locals * 8; 
     int64_t stackArgsSpace = std::max<int64_t>(0, f.arguments - 6) * 8; 
     if (localsSpace != 0) {
@@ -52,21 +91,21 @@ namespace L1{
   void CodeGenBehavior::act(Instruction_assignment &i) {
     EmitOptions options; 
     options.memoryStoredLabel = true; 
-    out << "  movq " << i.src()->emit(options) << ", " << i.dst()->emit() << "\n";
+    out << "  movq " << emitted(i.src(), options) << ", " << emitted(i.dst()) << "\n";
   }
 
   void CodeGenBehavior::act(Instruction_aop &i) {
-    out << "  " << assembly_from_aop(i.aop()) << " " << i.rhs()->emit() << ", " << i.dst()->emit() << "\n";
+    out << "  " << assembly_from_aop(i.aop()) << " " << emitted(i.rhs()) << ", " << emitted(i.dst()) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_sop &i) {
     EmitOptions options; 
     options.eightBitRegister = true; 
-    out << "  " << assembly_from_sop(i.sop()) << " "  << i.src()->emit(options) << ", " << i.dst()->emit() << "\n";
+    out << "  " << assembly_from_sop(i.sop()) << " "  << emitted(i.src(), options) << ", " << emitted(i.dst()) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_mem_aop &i) {
-    out << "  " << assembly_from_aop(i.aop()) << " " << i.rhs()->emit() << ", " << i.lhs()->emit() << "\n";
+    out << "  " << assembly_from_aop(i.aop()) << " " << emitted(i.rhs()) << ", " << emitted(i.lhs()) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_cmp_assignment &i) {
@@ -74,19 +113,19 @@ namespace L1{
     auto *rhs = dynamic_cast<const Number*>(i.rhs()); 
     bool compileTimeCalculate = lhs != nullptr && rhs != nullptr; 
     if (compileTimeCalculate) {
-      out << "  movq " << "$" << comp(lhs->value(), rhs->value(), i.cmp()) << ", " << i.dst()->emit() << "\n"; 
+      out << "  movq " << "$" << comp(lhs->value(), rhs->value(), i.cmp()) << ", " << emitted(i.dst()) << "\n"; 
       return; 
     }
 
     bool flip = lhs != nullptr && rhs == nullptr; 
-    std::string left = flip ? i.lhs()->emit() : i.rhs() -> emit(); 
-    std::string right = flip ? i.rhs()->emit() : i.lhs()->emit();
+    const Item* left = flip ? i.lhs() : i.rhs(); 
+    const Item* right = flip ? i.rhs() : i.lhs();
 
     EmitOptions options; 
     options.eightBitRegister = true; 
-    out << "  " << "cmpq " << left << ", " << right << "\n"; 
-    out << "  " << assembly_from_cmp(i.cmp(), flip) << " " << i.dst()->emit(options) << "\n"; 
-    out << "  " << "movzbq " << i.dst()->emit(options) << ", " << i.dst()->emit() << "\n"; 
+    out << "  " << "cmpq " << emitted(left) << ", " << emitted(right) << "\n"; 
+    out << "  " << assembly_from_cmp(i.cmp(), flip) << " " << emitted(i.dst(), options) << "\n"; 
+    out << "  " << "movzbq " << emitted(i.dst(), options) << ", " << emitted(i.dst()) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_cjump &i) {
@@ -95,25 +134,25 @@ namespace L1{
     bool compileTimeCalculate = lhs != nullptr && rhs != nullptr; 
     if (compileTimeCalculate) {
       if (comp(lhs->value(), rhs->value(), i.cmp())) {
-        out << "  " << "jmp " << i.label()->emit() << "\n";
+        out << "  " << "jmp " << emitted(i.label()) << "\n";
       }
       return; 
     }
 
     bool flip = lhs != nullptr && rhs == nullptr; 
-    std::string left = flip ? i.lhs()->emit() : i.rhs() -> emit(); 
-    std::string right = flip ? i.rhs()->emit() : i.lhs()->emit();
+    const Item* left = flip ? i.lhs() : i.rhs(); 
+    const Item* right = flip ? i.rhs() : i.lhs();
 
-    out << "  " << "cmpq " << left << ", " << right << "\n"; 
-    out << "  " << jump_assembly_from_cmp(i.cmp(), flip) << " " << i.label()->emit() << "\n";
+    out << "  " << "cmpq " << emitted(left) << ", " << emitted(right) << "\n"; 
+    out << "  " << jump_assembly_from_cmp(i.cmp(), flip) << " " << emitted(i.label()) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_label &i) {
-    out << "  " << i.label()->emit() << ":\n"; 
+    out << "  " << emitted(i.label()) << ":\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_goto &i) {
-    out << "  jmp " << i.label()->emit() << "\n";
+    out << "  jmp " << emitted(i.label()) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_ret &i) {
@@ -132,7 +171,7 @@ namespace L1{
       EmitOptions options; 
       options.functionCall = true;
       options.indirectRegCall = true; 
-      out << "  jmp " << i.callee()->emit(options) << "\n"; 
+      out << "  jmp " << emitted(i.callee(), options) << "\n"; 
     } else if (i.callType() == print) {
       out << "  call print\n"; 
     } else if (i.callType() == allocate) {
@@ -153,25 +192,225 @@ namespace L1{
   } 
 
   void CodeGenBehavior::act(Instruction_reg_inc_dec &i) {
-    out << "  " << assembly_from_inc_dec(i.op()) << " " << i.dst()->emit() << "\n"; 
+    out << "  " << assembly_from_inc_dec(i.op()) << " " << emitted(i.dst()) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_lea &i) {
-    out << "  lea " << "(" << i.lhs()->emit() << ", " << i.rhs()->emit() << ", " << i.scale()->emit().substr(1) << "), " << i.dst()->emit() << "\n";
+    out << "  lea " << "(" << emitted(i.lhs()) << ", " << emitted(i.rhs()) << ", " << i.scale()->value() << "), " << emitted(i.dst()) << "\n";
   } 
 
 
-  void generate_code(Program p){
+  void generate_code(Program &p, size_t jobs){
 
     std::ofstream outputFile;
     outputFile.open("prog.S");
 
     // codegen
-    CodeGenBehavior b(outputFile);
+    CodeGenBehavior b(outputFile, jobs);
     p.accept(b); 
 
     outputFile.close();
    
     return ;
   }
+
+  static Operand reg(RegisterID r) {
+    return Operand{Operand::Reg, r}; 
+  }
+
+  static std::string_view label_name(Symbol s) {
+    return std::string_view(symbol_name(s)).substr(1); 
+  }
+
+  static Operand operand(const Item* item) {
+    if (auto *r = dynamic_cast<const Register*>(item)) {
+      return reg(r->id()); 
+    }
+    if (auto *n = dynamic_cast<const Number*>(item)) {
+      return Operand{Operand::Imm, rax, n->value()}; 
+    }
+    if (auto *m = dynamic_cast<const Memory*>(item)) {
+      return Operand{Operand::Mem, m->getReg()->id(), m->getOffset()->value()}; 
+    }
+    if (auto *l = dynamic_cast<const Label*>(item)) {
+      return Operand{Operand::Address, rax, 0, label_name(l->symbol())}; 
+    }
+    if (auto *f = dynamic_cast<const Func*>(item)) {
+      return Operand{Operand::Address, rax, 0, label_name(f->symbol())}; 
+    }
+    throw std::runtime_error("unexpected operand"); 
+  }
+
+  ObjectCodeBehavior::ObjectCodeBehavior(size_t jobs)
+    : jobs (jobs) {
+      return; 
+    }
+
+  X86Encoder& ObjectCodeBehavior::encoder() {
+    return code; 
+  }
+
+  void ObjectCodeBehavior::act(Program &p) {
+    static const RegisterID calleeSaved[] = {rbx, rbp, r12, r13, r14, r15}; 
+    code.define_label("go", true); 
+    for (RegisterID r : calleeSaved) {
+      code.push(r); 
+    }
+    code.call(std::string_view(p.entryPointLabel).substr(1)); 
+    for (size_t k = std::size(calleeSaved); k-- > 0;) {
+      code.pop(calleeSaved[k]); 
+    }
+    code.ret(); 
+    if (jobs <= 1) {
+      for (Function* f: p.functions) {
+        f->accept(*this);
+      }
+    } else {
+      // Functions are encoded separately and appended in program order
+      std::vector<X86Encoder> parts(p.functions.size()); 
+      std::atomic<size_t> next{0}; 
+      std::vector<std::thread> workers; 
+      for (size_t t = 0; t < jobs; t++) {
+        workers.emplace_back([&] {
+          for (size_t f = next++; f < parts.size(); f = next++) {
+            ObjectCodeBehavior b; 
+            p.functions[f]->accept(b); 
+            parts[f] = std::move(b.code); 
+          }
+        }); 
+      }
+      for (auto& w : workers) {
+        w.join(); 
+      }
+      for (auto& part : parts) {
+        code.append(std::move(part)); 
+      }
+    }
+    code.resolve(); 
+  }
+
+  void ObjectCodeBehavior::act(Function& f) {
+    L1_TRACE(TraceCodegen, "encode " << f.name << ": " << f.instructions.size() << " instructions"); 
+    code.define_label(std::string_view(f.name).substr(1)); 
+    int64_t localsSpace = f.locals * 8; 
+    int64_t stackArgsSpace = std::max<int64_t>(0, f.arguments - 6) * 8; 
+    if (localsSpace != 0) {
+      code.aop(minus_equal, reg(rsp), Operand{Operand::Imm, rax, localsSpace}); 
+    }
+    this -> cur_frame_size = localsSpace + stackArgsSpace; 
+    for (Instruction* i: f.instructions) {
+      i -> accept(*this); 
+    }
+  }
+
+  void ObjectCodeBehavior::act(Instruction_assignment &i) {
+    code.mov(operand(i.dst()), operand(i.src())); 
+  }
+
+  void ObjectCodeBehavior::act(Instruction_aop &i) {
+    code.aop(i.aop(), reg(i.dst()->id()), operand(i.rhs())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_sop &i) {
+    code.sop(i.sop(), i.dst()->id(), operand(i.src())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_mem_aop &i) {
+    code.aop(i.aop(), operand(i.lhs()), operand(i.rhs())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_cmp_assignment &i) {
+    auto *lhs = dynamic_cast<const Number*>(i.lhs());
+    auto *rhs = dynamic_cast<const Number*>(i.rhs()); 
+    RegisterID dst = i.dst()->id(); 
+    if (lhs != nullptr && rhs != nullptr) {
+      code.mov(reg(dst), Operand{Operand::Imm, rax, comp(lhs->value(), rhs->value(), i.cmp())}); 
+      return; 
+    }
+
+    bool flip = lhs != nullptr && rhs == nullptr; 
+    const Item* left = flip ? i.lhs() : i.rhs(); 
+    const Item* right = flip ? i.rhs() : i.lhs();
+    code.cmp(operand(right), operand(left)); 
+    code.setcc(condition_from_cmp(i.cmp(), flip), dst); 
+    code.movzbq(dst, dst); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_cjump &i) {
+    auto *lhs = dynamic_cast<const Number*>(i.lhs());
+    auto *rhs = dynamic_cast<const Number*>(i.rhs()); 
+    if (lhs != nullptr && rhs != nullptr) {
+      if (comp(lhs->value(), rhs->value(), i.cmp())) {
+        code.jmp(label_name(i.label()->symbol())); 
+      }
+      return; 
+    }
+
+    bool flip = lhs != nullptr && rhs == nullptr; 
+    const Item* left = flip ? i.lhs() : i.rhs(); 
+    const Item* right = flip ? i.rhs() : i.lhs();
+    code.cmp(operand(right), operand(left)); 
+    code.jcc(condition_from_cmp(i.cmp(), flip), label_name(i.label()->symbol())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_label &i) {
+    code.define_label(label_name(i.label()->symbol())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_goto &i) {
+    code.jmp(label_name(i.label()->symbol())); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_ret &i) {
+    if (cur_frame_size != 0) {
+      code.aop(plus_equal, reg(rsp), Operand{Operand::Imm, rax, cur_frame_size}); 
+    }
+    code.ret(); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_call &i) {
+    if (i.callType() == l1) {
+      int64_t space = i.nArgs()->value() >= 6 ? (i.nArgs()->value() - 6) * 8 + 8 : 8; 
+      code.aop(minus_equal, reg(rsp), Operand{Operand::Imm, rax, space}); 
+      Operand callee = operand(i.callee()); 
+      if (callee.kind == Operand::Reg) {
+        code.jmp(callee.reg); 
+      } else {
+        code.jmp(callee.label); 
+      }
+    } else if (i.callType() == print) {
+      code.call_runtime("print"); 
+    } else if (i.callType() == allocate) {
+      code.call_runtime("allocate"); 
+    } else if (i.callType() == input) {
+      code.call_runtime("input"); 
+    } else if (i.callType() == tuple_error) {
+      code.call_runtime("tuple_error"); 
+    } else if (i.callType() == tensor_error) {
+      if (i.nArgs()->value() == 1) {
+        code.call_runtime("array_tensor_error_null"); 
+      } else if (i.nArgs()->value() == 3) {
+        code.call_runtime("array_error"); 
+      } else if (i.nArgs()->value() == 4) {
+        code.call_runtime("tensor_error"); 
+      }
+    }
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_reg_inc_dec &i) {
+    code.inc_dec(i.op(), i.dst()->id()); 
+  } 
+
+  void ObjectCodeBehavior::act(Instruction_lea &i) {
+    code.lea(i.dst()->id(), i.lhs()->id(), i.rhs()->id(), i.scale()->value()); 
+  } 
+
+  void generate_object(Program &p, size_t jobs){
+    ObjectCodeBehavior b(jobs);
+    p.accept(b); 
+
+    std::ofstream outputFile("prog.o", std::ios::binary);
+    write_elf_object(outputFile, b.encoder()); 
+    outputFile.close();
+  }
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <ostream>
+
 #include <L1.h>
+#include <x86_encoder.h>
 
 // Base visitor class with all the visit declarations 
 // Then concrete visitor class with all the visit definitions (like CodeGenVisitor ex)
@@ -41,7 +44,8 @@ namespace L1{
 
   class CodeGenBehavior : public Behavior {
     public:
-      explicit CodeGenBehavior(std::ofstream &out);
+      // jobs > 1 generates functions on that many threads
+      explicit CodeGenBehavior(std::ostream &stream, size_t jobs = 1);
       void act(Program &p) override; 
       void act(Function &f) override; 
       void act(Instruction_assignment &i) override; 
@@ -57,11 +61,54 @@ namespace L1{
       virtual void act(Instruction_reg_inc_dec &i) override; 
       virtual void act(Instruction_lea &i) override; 
 
+      // Writes the buffered code to the stream
+      void flush(); 
+
     private:
+      // Serial generation writes to the stream once this much code is buffered
+      static constexpr size_t flushSize = 1 << 20; 
+
       int64_t cur_frame_size; 
-      std::ofstream &out; 
+      Emitter out; 
+      std::ostream &stream; 
+      size_t jobs; 
   };
 
-  void generate_code(Program p);
+  /*
+   * Encodes what CodeGenBehavior would print straight to machine code, so the
+   * program can be written as an ELF object without running an assembler.
+   */
+  class ObjectCodeBehavior : public Behavior {
+    public:
+      // jobs > 1 encodes functions on that many threads
+      explicit ObjectCodeBehavior(size_t jobs = 1);
+      void act(Program &p) override; 
+      void act(Function &f) override; 
+      void act(Instruction_assignment &i) override; 
+      virtual void act(Instruction_aop &i) override; 
+      virtual void act(Instruction_sop &i) override; 
+      virtual void act(Instruction_mem_aop &i) override; 
+      virtual void act(Instruction_cmp_assignment &i) override; 
+      virtual void act(Instruction_cjump &i) override; 
+      virtual void act(Instruction_label &i) override; 
+      virtual void act(Instruction_goto &i) override; 
+      virtual void act(Instruction_ret &i) override; 
+      virtual void act(Instruction_call &i) override; 
+      virtual void act(Instruction_reg_inc_dec &i) override; 
+      virtual void act(Instruction_lea &i) override; 
+
+      // Resolved once the whole program has been visited
+      X86Encoder& encoder(); 
+
+    private:
+      int64_t cur_frame_size; 
+      X86Encoder code; 
+      size_t jobs; 
+  };
+
+  void generate_code(Program &p, size_t jobs = 1);
+
+  // Writes prog.o instead of prog.S
+  void generate_object(Program &p, size_t jobs = 1);
 
 }
@@ -15,10 +15,13 @@
 
 #include <parser.h>
 #include <code_generator.h>
+#include <jit.h>
+#include <peephole.h>
+#include <trace.h>
 
 
 void print_help (char *progName){
-  std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] SOURCE" << std::endl;
+  std::cerr << "Usage: " << progName << " [-v] [-t CATEGORIES] [-g 0|1] [-c] [-x] [-O 0|1|2] [-j N] SOURCE" << std::endl;
   return ;
 }
 
@@ -27,8 +30,11 @@ int main(
   char **argv
   ){
   auto enable_code_generator = false;
+  auto object_output = false;
+  auto execute = false;
   int32_t optLevel = 0;
-  bool verbose;
+  size_t jobs = 1;
+  bool verbose = false;
 
   /* 
    * Check the compiler arguments.
@@ -38,7 +44,7 @@ int main(
     return 1;
   }
   int32_t opt;
-  while ((opt = getopt(argc, argv, "vg:O:")) != -1) {
+  while ((opt = getopt(argc, argv, "vt:g:cxO:j:")) != -1) {
     switch (opt){
       case 'O':
         optLevel = strtoul(optarg, NULL, 0);
@@ -48,8 +54,25 @@ int main(
         enable_code_generator = (strtoul(optarg, NULL, 0) == 0) ? false : true ;
         break ;
 
+      case 'c':
+        object_output = true;
+        break ;
+
+      case 'x':
+        execute = true;
+        break ;
+
       case 'v':
         verbose = true;
+        L1::traceMask |= L1::TraceAll;
+        break ;
+
+      case 't':
+        L1::traceMask |= L1::trace_categories(optarg);
+        break ;
+
+      case 'j':
+        jobs = strtoul(optarg, NULL, 0);
         break ;
 
       default:
@@ -61,13 +84,35 @@ int main(
   /*
    * Parse the input file.
    */
+  if (verbose) {
+    L1::check_grammar();
+  }
   auto p = L1::parse_file(argv[optind]);
 
   /*
-   * Generate x86_64 assembly.
+   * Optimize.
+   */
+  if (optLevel > 0){
+    L1::optimize_peephole(p);
+  }
+
+  /*
+   * Run the program in this process.
+   */
+  if (execute){
+    L1::execute_program(p, jobs);
+    return 0;
+  }
+
+  /*
+   * Generate x86_64 assembly, or with -c an object file that needs no assembler.
    */
   if (enable_code_generator){
-    L1::generate_code(p);
+    if (object_output) {
+      L1::generate_object(p, jobs);
+    } else {
+      L1::generate_code(p, jobs);
+    }
   }
 
 
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <elf.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <elf_writer.h>
+
+namespace L1 {
+
+  // Section header indices
+  enum : uint16_t { TextSection = 1, RelaSection, SymtabSection, StrtabSection, ShstrtabSection, StackNoteSection, SectionCount };
+
+  // Appends name with a terminating zero and returns its offset
+  static uint32_t add_string(std::string &table, std::string_view prefix, std::string_view name) {
+    auto offset = static_cast<uint32_t>(table.size());
+    table.append(prefix);
+    table.append(name);
+    table.push_back('\0');
+    return offset;
+  }
+
+  template <typename T>
+  static void append(std::string &file, const T &value) {
+    file.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  static void append_all(std::string &file, const std::vector<T> &values) {
+    file.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  static size_t align(std::string &file, size_t alignment) {
+    file.resize((file.size() + alignment - 1) / alignment * alignment, '\0');
+    return file.size();
+  }
+
+  void write_elf_object(std::ostream &out, const X86Encoder &code) {
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> symbols(2, Elf64_Sym{});
+    symbols[1].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symbols[1].st_shndx = TextSection;
+
+    // Local symbols have to come before global ones
+    uint32_t firstGlobal = 0;
+    for (bool global : {false, true}) {
+      if (global) {
+        firstGlobal = static_cast<uint32_t>(symbols.size());
+      }
+      for (auto &l : code.labels()) {
+        if (l.global != global) continue;
+        Elf64_Sym s{};
+        s.st_name = add_string(strtab, global ? "" : "_", l.name);
+        s.st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+        s.st_shndx = TextSection;
+        s.st_value = l.offset;
+        symbols.push_back(s);
+      }
+    }
+
+    std::vector<Elf64_Rela> relocations;
+    std::unordered_map<std::string_view, uint32_t> runtimeSymbols;
+    for (auto &r : code.relocations()) {
+      uint32_t symbol = 1;
+      if (!r.symbol.empty()) {
+        auto it = runtimeSymbols.find(r.symbol);
+        if (it == runtimeSymbols.end()) {
+          Elf64_Sym s{};
+          s.st_name = add_string(strtab, "", r.symbol);
+          s.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+          s.st_shndx = SHN_UNDEF;
+          it = runtimeSymbols.emplace(r.symbol, static_cast<uint32_t>(symbols.size())).first;
+          symbols.push_back(s);
+        }
+        symbol = it->second;
+      }
+      Elf64_Rela rela{};
+      rela.r_offset = r.offset;
+      rela.r_info = ELF64_R_INFO(symbol, r.type);
+      rela.r_addend = r.addend;
+      relocations.push_back(rela);
+    }
+
+    std::string shstrtab(1, '\0');
+    std::vector<Elf64_Shdr> sections(SectionCount, Elf64_Shdr{});
+    auto section = [&](uint16_t index, std::string_view name, uint32_t type, uint64_t flags, size_t offset, size_t size, uint64_t alignment) {
+      Elf64_Shdr &s = sections[index];
+      s.sh_name = add_string(shstrtab, "", name);
+      s.sh_type = type;
+      s.sh_flags = flags;
+      s.sh_offset = offset;
+      s.sh_size = size;
+      s.sh_addralign = alignment;
+      return &s;
+    };
+
+    std::string file(sizeof(Elf64_Ehdr), '\0');
+    size_t offset = align(file, 16);
+    file.append(reinterpret_cast<const char*>(code.code().data()), code.code().size());
+    section(TextSection, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offset, code.code().size(), 16);
+
+    offset = align(file, 8);
+    append_all(file, relocations);
+    auto rela = section(RelaSection, ".rela.text", SHT_RELA, SHF_INFO_LINK, offset, file.size() - offset, 8);
+    rela->sh_link = SymtabSection;
+    rela->sh_info = TextSection;
+    rela->sh_entsize = sizeof(Elf64_Rela);
+
+    offset = align(file, 8);
+    append_all(file, symbols);
+    auto symtab = section(SymtabSection, ".symtab", SHT_SYMTAB, 0, offset, file.size() - offset, 8);
+    symtab->sh_link = StrtabSection;
+    symtab->sh_info = firstGlobal;
+    symtab->sh_entsize = sizeof(Elf64_Sym);
+
+    offset = file.size();
+    file.append(strtab);
+    section(StrtabSection, ".strtab", SHT_STRTAB, 0, offset, strtab.size(), 1);
+
+    // The stack does not need to be executable
+    section(StackNoteSection, ".note.GNU-stack", SHT_PROGBITS, 0, file.size(), 0, 1);
+
+    section(ShstrtabSection, ".shstrtab", SHT_STRTAB, 0, 0, 0, 1);
+    offset = file.size();
+    file.append(shstrtab);
+    sections[ShstrtabSection].sh_offset = offset;
+    sections[ShstrtabSection].sh_size = shstrtab.size();
+
+    size_t sectionHeaders = align(file, 8);
+    append_all(file, sections);
+
+    Elf64_Ehdr header{};
+    std::copy_n(ELFMAG, SELFMAG, header.e_ident);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = sectionHeaders;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = SectionCount;
+    header.e_shstrndx = ShstrtabSection;
+    file.replace(0, sizeof(header), reinterpret_cast<const char*>(&header), sizeof(header));
+
+    out.write(file.data(), file.size());
+  }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <ostream>
+
+#include <x86_encoder.h>
+
+namespace L1 {
+
+  /*
+   * Writes a relocatable x86-64 ELF object whose text section is the resolved
+   * code. Local labels become _name symbols as in prog.S, global labels are
+   * exported and runtime functions are left undefined for the linker.
+   */
+  void write_elf_object(std::ostream &out, const X86Encoder &code);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace L1 {
+
+  /*
+   * Growable buffer that generated code is appended to. Operands and numbers are
+   * written in place, so emitting an instruction does not allocate once the
+   * buffer has grown; the text reaches the stream in large writes.
+   */
+  class Emitter {
+    public:
+      Emitter& operator<<(std::string_view s) {
+        buffer.append(s);
+        return *this;
+      }
+
+      Emitter& operator<<(char c) {
+        buffer.push_back(c);
+        return *this;
+      }
+
+      template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>>>
+      Emitter& operator<<(T n) {
+        char digits[24];
+        auto end = std::to_chars(digits, digits + sizeof(digits), n).ptr;
+        buffer.append(digits, end - digits);
+        return *this;
+      }
+
+      size_t size() const { return buffer.size(); }
+      const std::string& str() const { return buffer; }
+
+      // Writes everything out and empties the buffer, keeping its capacity
+      void flush(std::ostream& out) {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+      }
+
+    private:
+      std::string buffer;
+  };
+}
@@ -1,29 +1,24 @@
+#include <charconv>
+
 #include <helper.h>
 
 namespace L1 {
-  std::string assembly_from_register(RegisterID id) {
-    switch (id) {
-      case RegisterID::rax: return "%rax";
-      case RegisterID::rbx: return "%rbx";
-      case RegisterID::rcx: return "%rcx";
-      case RegisterID::rdx: return "%rdx";
-      case RegisterID::rsi: return "%rsi";
-      case RegisterID::rdi: return "%rdi";
-      case RegisterID::rbp: return "%rbp";
-      case RegisterID::rsp: return "%rsp";
-      case RegisterID::r8:  return "%r8";
-      case RegisterID::r9:  return "%r9";
-      case RegisterID::r10: return "%r10";
-      case RegisterID::r11: return "%r11";
-      case RegisterID::r12: return "%r12";
-      case RegisterID::r13: return "%r13";
-      case RegisterID::r14: return "%r14";
-      case RegisterID::r15: return "%r15";
-      default:
-        throw std::runtime_error("invalid register");
-    }
+  // Register spellings, indexed by RegisterID
+  static const std::string_view registerAssembly[] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9", "%rax", "%rbx", "%rbp", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15", "%rsp"};
+  static const std::string_view eightBitRegisterAssembly[] = {"%dil", "%sil", "%dl", "%cl", "%r8b", "%r9b", "%al", "%bl", "%bpl", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b", "%spl"};
+  static const std::string_view indirectCallRegisterAssembly[] = {"*%rdi", "*%rsi", "*%rdx", "*%rcx", "*%r8", "*%r9", "*%rax", "*%rbx", "*%rbp", "*%r10", "*%r11", "*%r12", "*%r13", "*%r14", "*%r15", "*%rsp"};
+
+  std::string_view assembly_from_register(RegisterID id) {
+    return registerAssembly[id];
   }
 
+  std::string_view eightBitReg_assembly_from_register(RegisterID id) {
+    return eightBitRegisterAssembly[id];
+  }
+
+  std::string_view indirect_call_reg_assembly_from_register(RegisterID id) {
+    return indirectCallRegisterAssembly[id];
+  }
 
   AOP aop_from_string(std::string_view s) {
     return s == "+="  ? AOP::plus_equal:
@@ -46,7 +41,19 @@ namespace L1 {
     throw std::runtime_error("bad CMP");
   }
 
-  std::string string_from_aop(AOP op) {
+  int64_t number_from_string(std::string_view s) {
+    bool negative = !s.empty() && s[0] == '-';
+    if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+      s.remove_prefix(1);
+    }
+    uint64_t magnitude = 0;
+    if (std::from_chars(s.data(), s.data() + s.size(), magnitude).ec != std::errc()) {
+      throw std::runtime_error("bad number");
+    }
+    return static_cast<int64_t>(negative ? 0 - magnitude : magnitude);
+  }
+
+  std::string_view string_from_aop(AOP op) {
     switch (op) {
       case AOP::plus_equal:  return "+=";
       case AOP::minus_equal: return "-=";
@@ -57,7 +64,7 @@ namespace L1 {
     }
   }
 
-  std::string assembly_from_aop(AOP op) {
+  std::string_view assembly_from_aop(AOP op) {
     switch (op) {
       case AOP::plus_equal:  return "addq";
       case AOP::minus_equal: return "subq";
@@ -68,7 +75,7 @@ namespace L1 {
     }
   }
 
-  std::string string_from_sop(SOP op) {
+  std::string_view string_from_sop(SOP op) {
     switch (op) {
       case SOP::left_shift:  return "<<=";
       case SOP::right_shift: return ">>=";
@@ -77,7 +84,7 @@ namespace L1 {
     }
   }
 
-  std::string string_from_cmp(CMP cmp) {
+  std::string_view string_from_cmp(CMP cmp) {
     switch (cmp) {
       case CMP::less_than:        return "<";
       case CMP::less_than_equal:  return "<=";
@@ -87,7 +94,7 @@ namespace L1 {
     }
   }
 
-  std::string assembly_from_cmp(CMP cmp, bool flip) {
+  std::string_view assembly_from_cmp(CMP cmp, bool flip) {
     switch (cmp) {
       case CMP::less_than:        return flip ? "setg" : "setl";
       case CMP::less_than_equal:  return flip ? "setge" : "setle";
@@ -97,7 +104,7 @@ namespace L1 {
     }
   }
 
-  std::string jump_assembly_from_cmp(CMP cmp, bool flip) {
+  std::string_view jump_assembly_from_cmp(CMP cmp, bool flip) {
     switch (cmp) {
       case CMP::less_than:        return flip ? "jg" : "jl";
       case CMP::less_than_equal:  return flip ? "jge" : "jle";
@@ -107,7 +114,7 @@ namespace L1 {
     }
   }
 
-  std::string assembly_from_inc_dec(IncDec op) {
+  std::string_view assembly_from_inc_dec(IncDec op) {
     switch (op) {
       case increment:             return "inc"; 
       case decrement:             return "dec"; 
@@ -116,7 +123,7 @@ namespace L1 {
     }
   }
 
-  std::string assembly_from_sop(SOP op) {
+  std::string_view assembly_from_sop(SOP op) {
     switch (op) {
       case left_shift:            return "salq";
       case right_shift:           return "sarq"; 
@@ -125,56 +132,6 @@ namespace L1 {
     }
   }
 
-  std::string eightBitReg_assembly_from_register(RegisterID ID) {
-    switch (ID) {
-      case rax: return "%al";
-      case rbx: return "%bl";
-      case rcx: return "%cl";
-      case rdx: return "%dl";
-
-      case rdi: return "%dil";
-      case rsi: return "%sil";
-      case rbp: return "%bpl";
-      case rsp: return "%spl";
-
-      case r8:  return "%r8b";
-      case r9:  return "%r9b";
-      case r10: return "%r10b";
-      case r11: return "%r11b";
-      case r12: return "%r12b";
-      case r13: return "%r13b";
-      case r14: return "%r14b";
-      case r15: return "%r15b";
-    }
-
-  return "";
-  }
-
-
-  std::string indirect_call_reg_assembly_from_register(RegisterID id) {
-    switch (id) {
-      case RegisterID::rax: return "*%rax";
-      case RegisterID::rbx: return "*%rbx";
-      case RegisterID::rcx: return "*%rcx";
-      case RegisterID::rdx: return "*%rdx";
-      case RegisterID::rsi: return "*%rsi";
-      case RegisterID::rdi: return "*%rdi";
-      case RegisterID::rbp: return "*%rbp";
-      case RegisterID::rsp: return "*%rsp";
-      case RegisterID::r8:  return "*%r8";
-      case RegisterID::r9:  return "*%r9";
-      case RegisterID::r10: return "*%r10";
-      case RegisterID::r11: return "*%r11";
-      case RegisterID::r12: return "*%r12";
-      case RegisterID::r13: return "*%r13";
-      case RegisterID::r14: return "*%r14";
-      case RegisterID::r15: return "*%r15";
-      default:
-        throw std::runtime_error("invalid register");
-    }
-  }
-
-
   int comp(int64_t lhs, int64_t rhs, CMP op) {
     switch (op) {
       case less_than: return lhs < rhs; 
@@ -0,0 +1,163 @@
+#include <sys/mman.h>
+#include <elf.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <jit.h>
+#include <code_generator.h>
+#include <trace.h>
+
+namespace L1 {
+
+  /*
+   * Runtime. Odd words are numbers encoded as 2n+1; even ones point to arrays
+   * whose first word is their length. The error functions get the source line
+   * followed by the lengths and index involved, all encoded.
+   */
+  static void print_value(int64_t v, int depth) {
+    if (v & 1) {
+      std::printf("%" PRId64, v >> 1);
+      return;
+    }
+    if (depth >= 4) {
+      std::printf("...");
+      return;
+    }
+    auto *array = reinterpret_cast<const int64_t*>(v);
+    std::printf("{s:%" PRId64, array[0]);
+    for (int64_t k = 1; k <= array[0]; k++) {
+      std::printf(", ");
+      print_value(array[k], depth + 1);
+    }
+    std::printf("}");
+  }
+
+  [[noreturn]] static void runtime_failure() {
+    std::fflush(stdout);
+    std::exit(-1);
+  }
+
+  static void runtime_print(int64_t v) {
+    print_value(v, 0);
+    std::printf("\n");
+  }
+
+  static int64_t* runtime_allocate(int64_t fwSize, int64_t fill) {
+    int64_t size = fwSize >> 1;
+    auto *array = size < 0 ? nullptr : static_cast<int64_t*>(std::malloc((size + 1) * sizeof(int64_t)));
+    if (array == nullptr) {
+      std::printf("cannot allocate an array of %" PRId64 " elements\n", size);
+      runtime_failure();
+    }
+    array[0] = size;
+    std::fill(array + 1, array + 1 + size, fill);
+    return array;
+  }
+
+  static int64_t runtime_input() {
+    int64_t n = 0;
+    if (std::scanf("%" SCNd64, &n) != 1) {
+      n = 0;
+    }
+    return static_cast<int64_t>(static_cast<uint64_t>(n) << 1 | 1);
+  }
+
+  static void runtime_tuple_error(int64_t line, int64_t length, int64_t index) {
+    std::printf("line %" PRId64 ": attempted to use position %" PRId64 " of a tuple that only has %" PRId64 " positions\n", line >> 1, index >> 1, length >> 1);
+    runtime_failure();
+  }
+
+  static void runtime_array_tensor_error_null(int64_t line) {
+    std::printf("line %" PRId64 ": attempted to use a zero-initialized tensor\n", line >> 1);
+    runtime_failure();
+  }
+
+  static void runtime_array_error(int64_t line, int64_t length, int64_t index) {
+    std::printf("line %" PRId64 ": attempted to use position %" PRId64 " of an array that only has %" PRId64 " positions\n", line >> 1, index >> 1, length >> 1);
+    runtime_failure();
+  }
+
+  static void runtime_tensor_error(int64_t line, int64_t dimension, int64_t length, int64_t index) {
+    std::printf("line %" PRId64 ": attempted to use position %" PRId64 " of dimension %" PRId64 " of a tensor whose length is %" PRId64 "\n", line >> 1, index >> 1, dimension >> 1, length >> 1);
+    runtime_failure();
+  }
+
+  const RuntimeBindings& default_runtime() {
+    static const RuntimeBindings bindings = {
+      {"print", reinterpret_cast<const void*>(&runtime_print)},
+      {"allocate", reinterpret_cast<const void*>(&runtime_allocate)},
+      {"input", reinterpret_cast<const void*>(&runtime_input)},
+      {"tuple_error", reinterpret_cast<const void*>(&runtime_tuple_error)},
+      {"array_tensor_error_null", reinterpret_cast<const void*>(&runtime_array_tensor_error_null)},
+      {"array_error", reinterpret_cast<const void*>(&runtime_array_error)},
+      {"tensor_error", reinterpret_cast<const void*>(&runtime_tensor_error)},
+    };
+    return bindings;
+  }
+
+  void execute_program(Program &p, size_t jobs, const RuntimeBindings &runtime) {
+    ObjectCodeBehavior b(jobs);
+    p.accept(b);
+    const X86Encoder &code = b.encoder();
+
+    // The runtime may be out of rel32 reach, so each runtime call goes through a
+    // 16-byte stub after the code: jmp *0(%rip) followed by the target address
+    const size_t stubSize = 16;
+    size_t stubsStart = (code.code().size() + stubSize - 1) / stubSize * stubSize;
+    std::unordered_map<std::string_view, size_t> stubs;
+    for (auto &r : code.relocations()) {
+      if (!r.symbol.empty() && stubs.count(r.symbol) == 0) {
+        stubs.emplace(r.symbol, stubsStart + stubs.size() * stubSize);
+      }
+    }
+    size_t size = stubsStart + stubs.size() * stubSize;
+
+    // Label addresses are sign-extended 32-bit immediates, so the code has to sit in the low 2GB
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::runtime_error("cannot map memory for the program");
+    }
+    auto *base = static_cast<uint8_t*>(memory);
+    std::memcpy(base, code.code().data(), code.code().size());
+
+    for (auto &[symbol, offset] : stubs) {
+      auto it = runtime.find(symbol);
+      if (it == runtime.end()) {
+        munmap(memory, size);
+        throw std::runtime_error("no binding for runtime function " + std::string(symbol));
+      }
+      static const uint8_t jmp[] = {0xFF, 0x25, 0, 0, 0, 0};
+      auto target = reinterpret_cast<uintptr_t>(it->second);
+      std::memcpy(base + offset, jmp, sizeof(jmp));
+      std::memcpy(base + offset + sizeof(jmp), &target, sizeof(target));
+    }
+
+    for (auto &r : code.relocations()) {
+      int64_t value = r.type == R_X86_64_32S ? static_cast<int64_t>(reinterpret_cast<uintptr_t>(base)) + r.addend
+                                             : static_cast<int64_t>(stubs[r.symbol]) + r.addend - static_cast<int64_t>(r.offset);
+      auto value32 = static_cast<int32_t>(value);
+      std::memcpy(base + r.offset, &value32, sizeof(value32));
+    }
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, size);
+      throw std::runtime_error("cannot make the program executable");
+    }
+
+    size_t entry = 0;
+    for (auto &l : code.labels()) {
+      if (l.global && l.name == "go") {
+        entry = l.offset;
+      }
+    }
+    L1_TRACE(TraceCodegen, "jit: " << size << " bytes at " << memory << ", " << stubs.size() << " runtime stubs");
+    reinterpret_cast<void (*)()>(base + entry)();
+    std::fflush(stdout);
+    munmap(memory, size);
+  }
+}
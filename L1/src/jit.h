@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string_view>
+#include <unordered_map>
+
+#include <L1.h>
+
+namespace L1 {
+
+  // Address each runtime function (print, allocate, ...) is bound to
+  using RuntimeBindings = std::unordered_map<std::string_view, const void*>;
+
+  // In-process versions of the course runtime
+  const RuntimeBindings& default_runtime();
+
+  /*
+   * Encodes the program into an executable buffer, binds its runtime calls
+   * and runs go without assembling or linking anything.
+   */
+  void execute_program(Program &p, size_t jobs = 1, const RuntimeBindings &runtime = default_runtime());
+}
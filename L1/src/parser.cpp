@@ -30,6 +30,7 @@
 #include <L1.h>
 #include <parser.h>
 #include <helper.h> 
+#include <trace.h>
 
 namespace pegtl = TAO_PEGTL_NAMESPACE;
 
@@ -652,11 +653,11 @@ struct Instruction_rule:
   template<> struct action < function_name_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-      std::cout << "FUNCTION PARSING" << std::endl; 
+      L1_TRACE(TraceParse, "FUNCTION PARSING"); 
       if (p.entryPointLabel.empty()){
         p.entryPointLabel = in.string();
       } else {
-        auto newF = new Function();
+        auto newF = p.arena.make<Function>();
         newF->name = in.string();
         p.functions.push_back(newF);
       }
@@ -666,20 +667,20 @@ struct Instruction_rule:
   template<> struct action < argument_number > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "ARG NUMBER PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "ARG NUMBER PARSING"); 
 
       auto currentF = p.functions.back();
-      currentF->arguments = std::stoll(in.string());
+      currentF->arguments = number_from_string(in.string_view());
     }
   };
 
   template<> struct action < local_number > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "LOCAL NUMBER PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "LOCAL NUMBER PARSING"); 
 
       auto currentF = p.functions.back();
-      currentF->locals = std::stoll(in.string());
+      currentF->locals = number_from_string(in.string_view());
     }
   };
 
@@ -692,91 +693,91 @@ struct Instruction_rule:
   template<> struct action<register_rax_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      std::cout << "rax" << std::endl; 
-      parsed_items.push_back(new Register(RegisterID::rax)); }
+      L1_TRACE(TraceParse, "rax"); 
+      parsed_items.push_back(canonical_register(RegisterID::rax)); }
   };
 
   template<> struct action<register_rbx_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-            std::cout << "rbx" << std::endl; 
-      parsed_items.push_back(new Register(RegisterID::rbx)); }
+            L1_TRACE(TraceParse, "rbx"); 
+      parsed_items.push_back(canonical_register(RegisterID::rbx)); }
   };
 
   template<> struct action<register_rbp_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rbp)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rbp)); }
   };
 
   template<> struct action<register_r10_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r10)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r10)); }
   };
 
   template<> struct action<register_r11_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r11)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r11)); }
   };
 
   template<> struct action<register_r12_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r12)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r12)); }
   };
 
   template<> struct action<register_r13_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r13)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r13)); }
   };
 
   template<> struct action<register_r14_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-            std::cout << "r14" << std::endl; 
-      parsed_items.push_back(new Register(RegisterID::r14)); }
+            L1_TRACE(TraceParse, "r14"); 
+      parsed_items.push_back(canonical_register(RegisterID::r14)); }
   };
 
   template<> struct action<register_r15_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r15)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r15)); }
   };
 
   template<> struct action<register_rdi_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      std::cout << "rdi" << std::endl; 
-      parsed_items.push_back(new Register(RegisterID::rdi)); }
+      L1_TRACE(TraceParse, "rdi"); 
+      parsed_items.push_back(canonical_register(RegisterID::rdi)); }
   };
 
   template<> struct action<register_rsi_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rsi)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rsi)); }
   };
 
   template<> struct action<register_rdx_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      std::cout << "rdx" << std::endl; 
-      parsed_items.push_back(new Register(RegisterID::rdx)); }
+      L1_TRACE(TraceParse, "rdx"); 
+      parsed_items.push_back(canonical_register(RegisterID::rdx)); }
   };
 
   template<> struct action<register_rcx_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rcx)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rcx)); }
   };
 
   template<> struct action<register_r8_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r8)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r8)); }
   };
 
   template<> struct action<register_r9_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r9)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r9)); }
   };
 
   template<> struct action<register_rsp_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rsp)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rsp)); }
   };
 
 
@@ -784,8 +785,8 @@ struct Instruction_rule:
   template<> struct action < number > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto n = new Number(static_cast<uint64_t>(std::stoull(in.string())));
-      std::cout << in.string() << std::endl; 
+      auto n = make_number(p.arena, number_from_string(in.string_view()));
+      L1_TRACE(TraceParse, in.string_view()); 
       parsed_items.push_back(n);
     }
   };
@@ -794,8 +795,8 @@ struct Instruction_rule:
   template<> struct action < label_piece > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto l = new Label(in.string());
-      std::cout << in.string() << std::endl; 
+      auto l = p.arena.make<Label>(intern(in.string_view()));
+      L1_TRACE(TraceParse, in.string_view()); 
       parsed_items.push_back(l);
     }
   };
@@ -804,8 +805,8 @@ struct Instruction_rule:
   template<> struct action < function_name_piece_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto f = new Func(in.string());
-      std::cout << in.string() << std::endl; 
+      auto f = p.arena.make<Func>(intern(in.string_view()));
+      L1_TRACE(TraceParse, in.string_view()); 
       parsed_items.push_back(f);
     }
   };
@@ -814,7 +815,7 @@ struct Instruction_rule:
   template<> struct action < aop_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_aop = aop_from_string(in.string()); 
+      last_aop = aop_from_string(in.string_view()); 
     }
   };
 
@@ -822,8 +823,8 @@ struct Instruction_rule:
   template<> struct action < sop_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_sop = sop_from_string(in.string()); 
-      std::cout << in.string() << std::endl; 
+      last_sop = sop_from_string(in.string_view()); 
+      L1_TRACE(TraceParse, in.string_view()); 
     }
   };
 
@@ -832,8 +833,8 @@ struct Instruction_rule:
   template<> struct action < cmp_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_cmp = cmp_from_string(in.string()); 
-      std::cout << in.string() << std::endl; 
+      last_cmp = cmp_from_string(in.string_view()); 
+      L1_TRACE(TraceParse, in.string_view()); 
     }
   };
 
@@ -842,7 +843,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_assignment_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "ASSIGNMENT PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "ASSIGNMENT PARSING"); 
 
 
       /* 
@@ -861,7 +862,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(dst, src);
+      auto i = p.arena.make<Instruction_assignment>(dst, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -874,7 +875,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_memory_load_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "MEMORY LOAD PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "MEMORY LOAD PARSING"); 
 
 
       /* 
@@ -893,12 +894,12 @@ struct Instruction_rule:
       auto dst = parsed_items.back();
       parsed_items.pop_back();
 
-      auto mem = new Memory(static_cast<Register*> (src), static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(static_cast<Register*> (src), static_cast<Number*> (num));
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(dst, mem);
+      auto i = p.arena.make<Instruction_assignment>(dst, mem);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -910,7 +911,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_memory_store_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "MEMORY STORE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "MEMORY STORE PARSING"); 
 
 
       /* 
@@ -929,12 +930,12 @@ struct Instruction_rule:
       auto dst = parsed_items.back();
       parsed_items.pop_back();
 
-      auto mem = new Memory(static_cast<Register*> (dst), static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(static_cast<Register*> (dst), static_cast<Number*> (num));
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(mem, src);
+      auto i = p.arena.make<Instruction_assignment>(mem, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -947,7 +948,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_aop_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "AOP RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "AOP RULE PARSING"); 
 
 
       /* 
@@ -967,7 +968,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_aop(static_cast<Register*>(dst), last_aop, rhs);
+      auto i = p.arena.make<Instruction_aop>(static_cast<Register*>(dst), last_aop, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -979,7 +980,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_sop_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "SOP RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "SOP RULE PARSING"); 
 
 
       /* 
@@ -999,7 +1000,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_sop(static_cast<Register*>(dst), last_sop, rhs);
+      auto i = p.arena.make<Instruction_sop>(static_cast<Register*>(dst), last_sop, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1012,7 +1013,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_mem_arith_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "MEM ARITH PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "MEM ARITH PARSING"); 
 
 
       /* 
@@ -1033,13 +1034,13 @@ struct Instruction_rule:
       parsed_items.pop_back();
 
 
-      auto mem = new Memory(static_cast<Register*> (dst), static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(static_cast<Register*> (dst), static_cast<Number*> (num));
 
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_mem_aop(mem, last_aop, src);
+      auto i = p.arena.make<Instruction_mem_aop>(mem, last_aop, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1052,7 +1053,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_reg_arith_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "REG ARITH PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "REG ARITH PARSING"); 
 
 
       /* 
@@ -1073,13 +1074,13 @@ struct Instruction_rule:
       parsed_items.pop_back();
 
 
-      auto mem = new Memory(static_cast<Register*> (src), static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(static_cast<Register*> (src), static_cast<Number*> (num));
 
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_mem_aop(dst, last_aop, mem);
+      auto i = p.arena.make<Instruction_mem_aop>(dst, last_aop, mem);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1092,7 +1093,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_assignment_cmp_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "CMP ASSIGNMENT RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "CMP ASSIGNMENT RULE PARSING"); 
 
 
       /* 
@@ -1115,7 +1116,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_cmp_assignment(static_cast<Register*>(dst), lhs, last_cmp, rhs);
+      auto i = p.arena.make<Instruction_cmp_assignment>(static_cast<Register*>(dst), lhs, last_cmp, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1129,7 +1130,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_cjump_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "CJUMP RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "CJUMP RULE PARSING"); 
 
 
       /* 
@@ -1152,7 +1153,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_cjump(lhs, last_cmp, rhs, static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_cjump>(lhs, last_cmp, rhs, static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1165,7 +1166,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_label_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "label instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "label instruction RULE PARSING"); 
 
 
       /* 
@@ -1184,7 +1185,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_label(static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_label>(static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1196,7 +1197,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_goto_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "goto instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "goto instruction RULE PARSING"); 
 
 
       /* 
@@ -1215,7 +1216,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_goto(static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_goto>(static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1227,10 +1228,10 @@ struct Instruction_rule:
   template<> struct action < Instruction_return_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "RETURN PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "RETURN PARSING"); 
 
       auto currentF = p.functions.back();
-      auto i = new Instruction_ret();
+      auto i = p.arena.make<Instruction_ret>();
       currentF->instructions.push_back(i);
     }
   };
@@ -1238,7 +1239,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_l1_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "L1 call instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "L1 call instruction RULE PARSING"); 
 
 
       /* 
@@ -1259,7 +1260,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::l1, callee, static_cast<Number*>(nArgs)); 
+      auto i = p.arena.make<Instruction_call>(CallType::l1, callee, static_cast<Number*>(nArgs)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1272,7 +1273,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_print_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "print instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "print instruction RULE PARSING"); 
 
 
       /* 
@@ -1283,7 +1284,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::print, nullptr, new Number(1)); 
+      auto i = p.arena.make<Instruction_call>(CallType::print, nullptr, make_number(p.arena, 1)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1296,7 +1297,7 @@ struct Instruction_rule:
     template<> struct action < Instruction_input_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "input instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "input instruction RULE PARSING"); 
 
 
       /* 
@@ -1307,7 +1308,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::input, nullptr, new Number(0)); 
+      auto i = p.arena.make<Instruction_call>(CallType::input, nullptr, make_number(p.arena, 0)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1319,7 +1320,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_allocate_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "allocate instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "allocate instruction RULE PARSING"); 
 
 
       /* 
@@ -1330,7 +1331,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::allocate, nullptr, new Number(2)); 
+      auto i = p.arena.make<Instruction_call>(CallType::allocate, nullptr, make_number(p.arena, 2)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1342,7 +1343,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_tuple_error_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "tuple error instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "tuple error instruction RULE PARSING"); 
 
 
       /* 
@@ -1353,7 +1354,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::tuple_error, nullptr, new Number(3)); 
+      auto i = p.arena.make<Instruction_call>(CallType::tuple_error, nullptr, make_number(p.arena, 3)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1366,7 +1367,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_tensor_error_call_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "tensor error instruction RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "tensor error instruction RULE PARSING"); 
 
 
       /* 
@@ -1383,7 +1384,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::tensor_error, nullptr, static_cast<Number*>(number)); 
+      auto i = p.arena.make<Instruction_call>(CallType::tensor_error, nullptr, static_cast<Number*>(number)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1396,7 +1397,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_register_increment_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "register increment RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "register increment RULE PARSING"); 
 
 
       /* 
@@ -1415,7 +1416,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_reg_inc_dec(static_cast<Register*>(dst), IncDec::increment); 
+      auto i = p.arena.make<Instruction_reg_inc_dec>(static_cast<Register*>(dst), IncDec::increment); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1427,7 +1428,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_register_decrement_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "register decrement RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "register decrement RULE PARSING"); 
 
 
       /* 
@@ -1446,7 +1447,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_reg_inc_dec(static_cast<Register*>(dst), IncDec::decrement); 
+      auto i = p.arena.make<Instruction_reg_inc_dec>(static_cast<Register*>(dst), IncDec::decrement); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1460,7 +1461,7 @@ struct Instruction_rule:
   template<> struct action < Instruction_lea_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
-              std::cout << "lea RULE PARSING" << std::endl; 
+              L1_TRACE(TraceParse, "lea RULE PARSING"); 
 
 
       /* 
@@ -1484,7 +1485,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_lea(static_cast<Register*>(dst), static_cast<Register*>(lhs), static_cast<Register*>(rhs), static_cast<Number*>(number)); 
+      auto i = p.arena.make<Instruction_lea>(static_cast<Register*>(dst), static_cast<Register*>(lhs), static_cast<Register*>(rhs), static_cast<Number*>(number)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1494,20 +1495,23 @@ struct Instruction_rule:
   };
 
 
-  Program parse_file (char *fileName){
-
-    /* 
-     * Check the grammar for some possible issues.
-     */
+  /* 
+   * Check the grammar for some possible issues. This walks the whole grammar, so it
+   * only runs when asked for rather than on every parse.
+   */
+  void check_grammar (){
     if (pegtl::analyze< grammar >() != 0){
       std::cerr << "There are problems with the grammar" << std::endl;
       exit(1);
     }
+  }
+
+  Program parse_file (char *fileName){
 
     /*
      * Parse.
      */
-    file_input< > fileInput(fileName);
+    mmap_input< > fileInput(fileName);
     Program p;
     parse< grammar, action >(fileInput, p);
 
@@ -3,5 +3,7 @@
 #include <L1.h>
 
 namespace L1 {
+    // Debug check of the grammar itself, not of any input
+    void check_grammar(); 
     Program parse_file(char* fileName); 
 }
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <vector>
+
+#include <peephole.h>
+#include <trace.h>
+
+namespace L1 {
+
+  namespace {
+    // Looks at the first `window` instructions at w; on a match fills replacement
+    // with what they become (possibly nothing) and returns true
+    using Rewrite = bool (*)(Instruction* const* w, Arena &arena, std::vector<Instruction*> &replacement);
+
+    struct PeepholeRule {
+      const char* name;
+      size_t window;
+      Rewrite rewrite;
+    };
+
+    template <typename T>
+    const T* as(const Instruction* i) {
+      return dynamic_cast<const T*>(i);
+    }
+
+    bool same_item(const Item* a, const Item* b) {
+      if (auto *r = dynamic_cast<const Register*>(a)) {
+        auto *s = dynamic_cast<const Register*>(b);
+        return s != nullptr && r->id() == s->id();
+      }
+      if (auto *m = dynamic_cast<const Memory*>(a)) {
+        auto *n = dynamic_cast<const Memory*>(b);
+        return n != nullptr && m->getReg()->id() == n->getReg()->id() && m->getOffset()->value() == n->getOffset()->value();
+      }
+      return false;
+    }
+
+    bool is_number(const Item* item, int64_t n) {
+      auto *number = dynamic_cast<const Number*>(item);
+      return number != nullptr && number->value() == n;
+    }
+
+    // w <- w
+    bool self_move(Instruction* const* w, Arena &, std::vector<Instruction*> &) {
+      auto *a = as<Instruction_assignment>(w[0]);
+      return a != nullptr && dynamic_cast<const Register*>(a->dst()) && same_item(a->dst(), a->src());
+    }
+
+    // mem x M <- s; w <- mem x M  =>  mem x M <- s; w <- s
+    bool store_reload(Instruction* const* w, Arena &arena, std::vector<Instruction*> &replacement) {
+      auto *store = as<Instruction_assignment>(w[0]);
+      auto *load = as<Instruction_assignment>(w[1]);
+      if (store == nullptr || load == nullptr || !dynamic_cast<const Memory*>(store->dst()) || !same_item(store->dst(), load->src())) {
+        return false;
+      }
+      // Items are immutable and arena-owned, so the new move can share them
+      auto *move = arena.make<Instruction_assignment>(const_cast<Item*>(load->dst()), const_cast<Item*>(store->src()));
+      replacement = {w[0], move};
+      return true;
+    }
+
+    // w += 0, w -= 0, w *= 1, w &= -1, w <<= 0, w >>= 0
+    bool arithmetic_identity(Instruction* const* w, Arena &, std::vector<Instruction*> &) {
+      if (auto *a = as<Instruction_aop>(w[0])) {
+        switch (a->aop()) {
+          case AOP::plus_equal:
+          case AOP::minus_equal:  return is_number(a->rhs(), 0);
+          case AOP::times_equal:  return is_number(a->rhs(), 1);
+          case AOP::and_equal:    return is_number(a->rhs(), -1);
+        }
+      }
+      if (auto *s = as<Instruction_sop>(w[0])) {
+        return is_number(s->src(), 0);
+      }
+      return false;
+    }
+
+    // goto :L or cjump ... :L right before :L
+    bool jump_to_next(Instruction* const* w, Arena &, std::vector<Instruction*> &replacement) {
+      auto *next = as<Instruction_label>(w[1]);
+      if (next == nullptr) {
+        return false;
+      }
+      const Label* target = nullptr;
+      if (auto *g = as<Instruction_goto>(w[0])) {
+        target = g->label();
+      } else if (auto *c = as<Instruction_cjump>(w[0])) {
+        target = c->label();
+      }
+      if (target == nullptr || target->symbol() != next->label()->symbol()) {
+        return false;
+      }
+      replacement = {w[1]};
+      return true;
+    }
+
+    // A new rule only needs an entry here
+    constexpr PeepholeRule rules[] = {
+      {"self move", 1, self_move},
+      {"store then reload", 2, store_reload},
+      {"arithmetic identity", 1, arithmetic_identity},
+      {"jump to next instruction", 2, jump_to_next},
+    };
+
+    void optimize_function(Function &f, Arena &arena) {
+      std::vector<Instruction*> out;
+      std::vector<Instruction*> replacement;
+      out.reserve(f.instructions.size());
+      size_t rewrites = 0;
+
+      // Rules are matched against the end of the output, so a rewrite that
+      // exposes another match is picked up right away
+      for (Instruction* i : f.instructions) {
+        out.push_back(i);
+        for (bool again = true; again;) {
+          again = false;
+          for (auto &rule : rules) {
+            if (out.size() < rule.window) continue;
+            replacement.clear();
+            if (!rule.rewrite(&out[out.size() - rule.window], arena, replacement)) continue;
+            L1_TRACE(TracePeephole, f.name << ": " << rule.name);
+            out.resize(out.size() - rule.window);
+            out.insert(out.end(), replacement.begin(), replacement.end());
+            rewrites++;
+            again = true;
+            break;
+          }
+        }
+      }
+      L1_TRACE(TracePeephole, "peephole " << f.name << ": " << rewrites << " rewrites, " << f.instructions.size() << " -> " << out.size() << " instructions");
+      f.instructions = std::move(out);
+    }
+  }
+
+  void optimize_peephole(Program &p) {
+    for (Function* f : p.functions) {
+      optimize_function(*f, p.arena);
+    }
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <L1.h>
+
+namespace L1 {
+
+  /*
+   * Rewrites every function through a table of small window rules before code
+   * generation: self moves, reloads of a slot that was just stored, arithmetic
+   * identities and jumps to the very next instruction.
+   */
+  void optimize_peephole(Program &p);
+}
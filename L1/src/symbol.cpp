@@ -0,0 +1,41 @@
+#include <symbol.h>
+
+namespace L1 {
+
+  Symbol SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    Symbol s = static_cast<Symbol>(names.size());
+    names.emplace_back(name);
+    // keys view the deque's strings, which never move
+    ids.emplace(names.back(), s);
+    return s;
+  }
+
+  bool SymbolTable::contains(std::string_view name) const {
+    return ids.count(name) != 0;
+  }
+
+  const std::string& SymbolTable::name(Symbol s) const {
+    return names[s];
+  }
+
+  size_t SymbolTable::size() const {
+    return names.size();
+  }
+
+  SymbolTable& symbols() {
+    static SymbolTable table;
+    return table;
+  }
+
+  Symbol intern(std::string_view name) {
+    return symbols().intern(name);
+  }
+
+  const std::string& symbol_name(Symbol s) {
+    return symbols().name(s);
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace L1 {
+
+  // Interned name of a variable, label or function
+  using Symbol = uint32_t;
+
+  /*
+   * Every name is mapped to a small integer once, when it is parsed, so later
+   * passes compare and hash integers instead of strings.
+   */
+  class SymbolTable {
+    public:
+      Symbol intern(std::string_view name);
+      bool contains(std::string_view name) const;
+      const std::string& name(Symbol s) const;
+      size_t size() const;
+
+    private:
+      std::deque<std::string> names;
+      std::unordered_map<std::string_view, Symbol> ids;
+  };
+
+  SymbolTable& symbols();
+
+  Symbol intern(std::string_view name);
+  const std::string& symbol_name(Symbol s);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace L1 {
+
+  // Diagnostic categories, selected with -t (comma separated) or all at once with -v
+  enum TraceCategory : uint32_t {
+    TraceParse = 1,
+    TraceCodegen = 2,
+    TracePeephole = 4,
+    TraceAll = 7
+  };
+
+  // Building with -DL1_NO_TRACE removes every trace point
+#ifdef L1_NO_TRACE
+  inline constexpr bool traceCompiledIn = false;
+#else
+  inline constexpr bool traceCompiledIn = true;
+#endif
+
+  extern uint32_t traceMask;
+
+  inline bool trace_enabled(uint32_t category) {
+    return traceCompiledIn && (traceMask & category) != 0;
+  }
+
+  // Parses "parse,codegen" style lists; throws on an unknown name
+  uint32_t trace_categories(std::string_view list);
+
+  // Appends one line to the trace buffer, which goes to stderr in large chunks
+  void trace_write(const std::string& line);
+  void trace_flush();
+}
+
+// The message is only formatted when its category is on
+#define L1_TRACE(category, message) \
+  do { \
+    if (::L1::trace_enabled(category)) { \
+      std::ostringstream traceLine; \
+      traceLine << message << '\n'; \
+      ::L1::trace_write(traceLine.str()); \
+    } \
+  } while (0)
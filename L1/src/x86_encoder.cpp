@@ -0,0 +1,350 @@
+#include <elf.h>
+#include <stdexcept>
+#include <string>
+
+#include <x86_encoder.h>
+
+namespace L1 {
+
+  // Hardware register numbers in RegisterID order
+  static const uint8_t hardwareNumber[] = {7, 6, 2, 1, 8, 9, 0, 3, 5, 10, 11, 12, 13, 14, 15, 4};
+
+  static unsigned hw(RegisterID r) {
+    return hardwareNumber[r];
+  }
+
+  static bool fits8(int64_t v) {
+    return v >= INT8_MIN && v <= INT8_MAX;
+  }
+
+  static bool fits32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+  }
+
+  static bool isRegisterOrMemory(const Operand& o) {
+    return o.kind == Operand::Reg || o.kind == Operand::Mem;
+  }
+
+  Condition condition_from_cmp(CMP cmp, bool flip) {
+    switch (cmp) {
+      case CMP::less_than:        return flip ? Greater : Less;
+      case CMP::less_than_equal:  return flip ? GreaterEqual : LessEqual;
+      case CMP::equal:            return Equal;
+      default:
+        throw std::runtime_error("bad CMP");
+    }
+  }
+
+  void X86Encoder::byte(uint8_t b) {
+    bytes.push_back(b);
+  }
+
+  void X86Encoder::imm8(int64_t v) {
+    byte(static_cast<uint8_t>(v));
+  }
+
+  void X86Encoder::imm32(const Operand& src) {
+    int64_t v = src.value;
+    if (src.kind == Operand::Address) {
+      addresses.push_back(Fixup{bytes.size(), src.label});
+      v = 0;
+    } else if (!fits32(v)) {
+      throw std::runtime_error("immediate does not fit in 32 bits: " + std::to_string(v));
+    }
+    for (int k = 0; k < 4; k++) {
+      byte(static_cast<uint8_t>(v >> (8 * k)));
+    }
+  }
+
+  void X86Encoder::rel32(std::string_view label) {
+    jumps.push_back(Fixup{bytes.size(), label});
+    bytes.insert(bytes.end(), 4, 0);
+  }
+
+  // byteRegister: spl, bpl, sil and dil need a REX prefix even without any of its bits
+  void X86Encoder::rex(bool wide, unsigned reg, const Operand& rm, bool byteRegister) {
+    unsigned base = isRegisterOrMemory(rm) ? hw(rm.reg) : 0;
+    uint8_t prefix = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+    if (prefix != 0x40 || (byteRegister && rm.kind == Operand::Reg && base >= 4)) {
+      byte(prefix);
+    }
+  }
+
+  void X86Encoder::modrm(unsigned reg, const Operand& rm) {
+    unsigned base = hw(rm.reg) & 7;
+    if (rm.kind == Operand::Reg) {
+      byte(0xC0 | (reg & 7) << 3 | base);
+      return;
+    }
+    if (!fits32(rm.value)) {
+      throw std::runtime_error("memory offset does not fit in 32 bits: " + std::to_string(rm.value));
+    }
+    // rbp and r13 have no form without a displacement
+    uint8_t mod = rm.value == 0 && base != 5 ? 0 : fits8(rm.value) ? 1 : 2;
+    byte(mod << 6 | (reg & 7) << 3 | base);
+    // rsp and r12 need a SIB byte
+    if (base == 4) {
+      byte(0x24);
+    }
+    if (mod == 1) {
+      imm8(rm.value);
+    } else if (mod == 2) {
+      imm32(Operand{Operand::Imm, rax, rm.value});
+    }
+  }
+
+  // add, sub, and and cmp: extension selects the immediate form, rmReg and regRm the two register forms
+  void X86Encoder::arithmetic(uint8_t extension, uint8_t rmReg, uint8_t regRm, const Operand& dst, const Operand& src) {
+    if ((src.kind == Operand::Imm || src.kind == Operand::Address) && isRegisterOrMemory(dst)) {
+      bool shortForm = src.kind == Operand::Imm && fits8(src.value);
+      rex(true, 0, dst);
+      byte(shortForm ? 0x83 : 0x81);
+      modrm(extension, dst);
+      if (shortForm) {
+        imm8(src.value);
+      } else {
+        imm32(src);
+      }
+    } else if (src.kind == Operand::Reg && isRegisterOrMemory(dst)) {
+      rex(true, hw(src.reg), dst);
+      byte(rmReg);
+      modrm(hw(src.reg), dst);
+    } else if (src.kind == Operand::Mem && dst.kind == Operand::Reg) {
+      rex(true, hw(dst.reg), src);
+      byte(regRm);
+      modrm(hw(dst.reg), src);
+    } else {
+      throw std::runtime_error("invalid operands for arithmetic instruction");
+    }
+  }
+
+  void X86Encoder::define_label(std::string_view name, bool global) {
+    if (!global && !labelOffsets.emplace(name, bytes.size()).second) {
+      throw std::runtime_error("label defined twice: _" + std::string(name));
+    }
+    definitions.push_back(LabelDefinition{name, bytes.size(), global});
+  }
+
+  void X86Encoder::mov(const Operand& dst, const Operand& src) {
+    if (src.kind == Operand::Imm && !fits32(src.value) && dst.kind == Operand::Reg) {
+      // movabs
+      rex(true, 0, dst);
+      byte(0xB8 | (hw(dst.reg) & 7));
+      for (int k = 0; k < 8; k++) {
+        byte(static_cast<uint8_t>(src.value >> (8 * k)));
+      }
+    } else if ((src.kind == Operand::Imm || src.kind == Operand::Address) && isRegisterOrMemory(dst)) {
+      rex(true, 0, dst);
+      byte(0xC7);
+      modrm(0, dst);
+      imm32(src);
+    } else if (src.kind == Operand::Reg && isRegisterOrMemory(dst)) {
+      rex(true, hw(src.reg), dst);
+      byte(0x89);
+      modrm(hw(src.reg), dst);
+    } else if (src.kind == Operand::Mem && dst.kind == Operand::Reg) {
+      rex(true, hw(dst.reg), src);
+      byte(0x8B);
+      modrm(hw(dst.reg), src);
+    } else {
+      throw std::runtime_error("invalid operands for movq");
+    }
+  }
+
+  void X86Encoder::aop(AOP op, const Operand& dst, const Operand& src) {
+    switch (op) {
+      case AOP::plus_equal:   arithmetic(0, 0x01, 0x03, dst, src); return;
+      case AOP::minus_equal:  arithmetic(5, 0x29, 0x2B, dst, src); return;
+      case AOP::and_equal:    arithmetic(4, 0x21, 0x23, dst, src); return;
+      case AOP::times_equal:  break;
+      default:
+        throw std::runtime_error("bad AOP");
+    }
+    if (dst.kind != Operand::Reg) {
+      throw std::runtime_error("invalid operands for imulq");
+    }
+    unsigned d = hw(dst.reg);
+    if (src.kind == Operand::Imm || src.kind == Operand::Address) {
+      bool shortForm = src.kind == Operand::Imm && fits8(src.value);
+      rex(true, d, dst);
+      byte(shortForm ? 0x6B : 0x69);
+      modrm(d, dst);
+      if (shortForm) {
+        imm8(src.value);
+      } else {
+        imm32(src);
+      }
+      return;
+    }
+    rex(true, d, src);
+    byte(0x0F);
+    byte(0xAF);
+    modrm(d, src);
+  }
+
+  // Sets the flags for lhs - rhs, like cmpq rhs, lhs
+  void X86Encoder::cmp(const Operand& lhs, const Operand& rhs) {
+    arithmetic(7, 0x39, 0x3B, lhs, rhs);
+  }
+
+  void X86Encoder::sop(SOP op, RegisterID dst, const Operand& count) {
+    Operand d{Operand::Reg, dst};
+    unsigned extension = op == SOP::left_shift ? 4 : 7;
+    if (count.kind == Operand::Reg && count.reg == rcx) {
+      rex(true, 0, d);
+      byte(0xD3);
+      modrm(extension, d);
+    } else if (count.kind == Operand::Imm && count.value >= INT8_MIN && count.value <= UINT8_MAX) {
+      rex(true, 0, d);
+      byte(0xC1);
+      modrm(extension, d);
+      imm8(count.value);
+    } else {
+      throw std::runtime_error("shift count must be %cl or a byte immediate");
+    }
+  }
+
+  void X86Encoder::setcc(Condition c, RegisterID dst) {
+    Operand d{Operand::Reg, dst};
+    rex(false, 0, d, true);
+    byte(0x0F);
+    byte(0x90 | c);
+    modrm(0, d);
+  }
+
+  void X86Encoder::movzbq(RegisterID dst, RegisterID src) {
+    rex(true, hw(dst), Operand{Operand::Reg, src});
+    byte(0x0F);
+    byte(0xB6);
+    modrm(hw(dst), Operand{Operand::Reg, src});
+  }
+
+  void X86Encoder::inc_dec(IncDec op, RegisterID dst) {
+    Operand d{Operand::Reg, dst};
+    rex(true, 0, d);
+    byte(0xFF);
+    modrm(op == IncDec::increment ? 0 : 1, d);
+  }
+
+  void X86Encoder::lea(RegisterID dst, RegisterID base, RegisterID index, int64_t scale) {
+    uint8_t scaleBits = scale == 1 ? 0 : scale == 2 ? 1 : scale == 4 ? 2 : scale == 8 ? 3 : 4;
+    if (scaleBits == 4) {
+      throw std::runtime_error("lea scale must be 1, 2, 4 or 8");
+    }
+    if (index == rsp) {
+      throw std::runtime_error("%rsp cannot be an index register");
+    }
+    unsigned r = hw(dst), b = hw(base), x = hw(index);
+    byte(0x48 | (r & 8 ? 4 : 0) | (x & 8 ? 2 : 0) | (b & 8 ? 1 : 0));
+    byte(0x8D);
+    // rbp and r13 as base need a zero displacement
+    uint8_t mod = (b & 7) == 5 ? 1 : 0;
+    byte(mod << 6 | (r & 7) << 3 | 4);
+    byte(scaleBits << 6 | (x & 7) << 3 | (b & 7));
+    if (mod == 1) {
+      byte(0);
+    }
+  }
+
+  void X86Encoder::jmp(std::string_view label) {
+    byte(0xE9);
+    rel32(label);
+  }
+
+  void X86Encoder::jmp(RegisterID target) {
+    Operand t{Operand::Reg, target};
+    rex(false, 0, t);
+    byte(0xFF);
+    modrm(4, t);
+  }
+
+  void X86Encoder::jcc(Condition c, std::string_view label) {
+    byte(0x0F);
+    byte(0x80 | c);
+    rel32(label);
+  }
+
+  void X86Encoder::call(std::string_view label) {
+    byte(0xE8);
+    rel32(label);
+  }
+
+  void X86Encoder::call_runtime(std::string_view symbol) {
+    byte(0xE8);
+    relocs.push_back(Relocation{bytes.size(), R_X86_64_PLT32, symbol, -4});
+    bytes.insert(bytes.end(), 4, 0);
+  }
+
+  void X86Encoder::push(RegisterID r) {
+    if (hw(r) & 8) {
+      byte(0x41);
+    }
+    byte(0x50 | (hw(r) & 7));
+  }
+
+  void X86Encoder::pop(RegisterID r) {
+    if (hw(r) & 8) {
+      byte(0x41);
+    }
+    byte(0x58 | (hw(r) & 7));
+  }
+
+  void X86Encoder::ret() {
+    byte(0xC3);
+  }
+
+  void X86Encoder::append(X86Encoder&& other) {
+    size_t shift = bytes.size();
+    bytes.insert(bytes.end(), other.bytes.begin(), other.bytes.end());
+    for (auto& d : other.definitions) {
+      if (!d.global && !labelOffsets.emplace(d.name, d.offset + shift).second) {
+        throw std::runtime_error("label defined twice: _" + std::string(d.name));
+      }
+      definitions.push_back(LabelDefinition{d.name, d.offset + shift, d.global});
+    }
+    for (auto& f : other.jumps) {
+      jumps.push_back(Fixup{f.offset + shift, f.label});
+    }
+    for (auto& f : other.addresses) {
+      addresses.push_back(Fixup{f.offset + shift, f.label});
+    }
+    for (auto& r : other.relocs) {
+      relocs.push_back(Relocation{r.offset + shift, r.type, r.symbol, r.addend});
+    }
+    other = X86Encoder{};
+  }
+
+  void X86Encoder::resolve() {
+    auto target = [&](std::string_view label) {
+      auto it = labelOffsets.find(label);
+      if (it == labelOffsets.end()) {
+        throw std::runtime_error("undefined label _" + std::string(label));
+      }
+      return it->second;
+    };
+    for (auto& f : jumps) {
+      auto rel = static_cast<int32_t>(target(f.label) - (f.offset + 4));
+      for (int k = 0; k < 4; k++) {
+        bytes[f.offset + k] = static_cast<uint8_t>(rel >> (8 * k));
+      }
+    }
+    // Absolute addresses are only known once the linker places the text section
+    for (auto& f : addresses) {
+      relocs.push_back(Relocation{f.offset, R_X86_64_32S, {}, static_cast<int64_t>(target(f.label))});
+    }
+    jumps.clear();
+    addresses.clear();
+  }
+
+  const std::vector<uint8_t>& X86Encoder::code() const {
+    return bytes;
+  }
+
+  const std::vector<X86Encoder::LabelDefinition>& X86Encoder::labels() const {
+    return definitions;
+  }
+
+  const std::vector<X86Encoder::Relocation>& X86Encoder::relocations() const {
+    return relocs;
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <L1.h>
+
+namespace L1 {
+
+  // Operand of an encoded instruction
+  struct Operand {
+    enum Kind { Reg, Imm, Mem, Address };
+
+    Kind kind = Reg;
+    // Reg, or the base register of Mem
+    RegisterID reg = rax;
+    // Imm, or the displacement of Mem
+    int64_t value = 0;
+    // Address: the label whose address is the immediate
+    std::string_view label = {};
+  };
+
+  // Condition codes of jcc/setcc
+  enum Condition : uint8_t { Equal = 0x4, Less = 0xC, GreaterEqual = 0xD, LessEqual = 0xE, Greater = 0xF };
+
+  Condition condition_from_cmp(CMP cmp, bool flip);
+
+  /*
+   * Assembles x86-64 machine code into a byte buffer. Label names are given
+   * without their prefix, like the _name symbols of prog.S. Jumps and calls to
+   * labels are patched by resolve(); label addresses used as immediates and
+   * calls into the runtime become relocations for the linker.
+   */
+  class X86Encoder {
+    public:
+      struct LabelDefinition {
+        std::string_view name;
+        size_t offset;
+        bool global;
+      };
+
+      // An empty symbol means the text section, with the label offset as addend
+      struct Relocation {
+        size_t offset;
+        uint32_t type;
+        std::string_view symbol;
+        int64_t addend;
+      };
+
+      void define_label(std::string_view name, bool global = false);
+
+      // Operands are in Intel order: destination first
+      void mov(const Operand& dst, const Operand& src);
+      void aop(AOP op, const Operand& dst, const Operand& src);
+      void cmp(const Operand& lhs, const Operand& rhs);
+      void sop(SOP op, RegisterID dst, const Operand& count);
+      void setcc(Condition c, RegisterID dst);
+      void movzbq(RegisterID dst, RegisterID src);
+      void inc_dec(IncDec op, RegisterID dst);
+      void lea(RegisterID dst, RegisterID base, RegisterID index, int64_t scale);
+      void jmp(std::string_view label);
+      void jmp(RegisterID target);
+      void jcc(Condition c, std::string_view label);
+      void call(std::string_view label);
+      void call_runtime(std::string_view symbol);
+      void push(RegisterID r);
+      void pop(RegisterID r);
+      void ret();
+
+      // Moves the code of other to the end of this buffer
+      void append(X86Encoder&& other);
+
+      // Patches label references; throws if a label is not defined
+      void resolve();
+
+      const std::vector<uint8_t>& code() const;
+      const std::vector<LabelDefinition>& labels() const;
+      const std::vector<Relocation>& relocations() const;
+
+    private:
+      struct Fixup {
+        size_t offset;
+        std::string_view label;
+      };
+
+      void byte(uint8_t b);
+      void imm8(int64_t v);
+      void imm32(const Operand& src);
+      void rel32(std::string_view label);
+      void rex(bool wide, unsigned reg, const Operand& rm, bool byteRegister = false);
+      void modrm(unsigned reg, const Operand& rm);
+      void arithmetic(uint8_t extension, uint8_t rmReg, uint8_t regRm, const Operand& dst, const Operand& src);
+
+      std::vector<uint8_t> bytes;
+      std::vector<LabelDefinition> definitions;
+      std::unordered_map<std::string_view, size_t> labelOffsets;
+      // rel32 jump and call targets
+      std::vector<Fixup> jumps;
+      // imm32 label addresses
+      std::vector<Fixup> addresses;
+      std::vector<Relocation> relocs;
+  };
+
+}
@@ -0,0 +1,253 @@
+#include <cstring>
+#include <elf.h>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <test.h>
+#include <x86_encoder.h>
+#include <elf_writer.h>
+
+using namespace L1;
+
+static Operand reg(RegisterID r) {
+  return Operand{Operand::Reg, r};
+}
+
+static Operand imm(int64_t v) {
+  return Operand{Operand::Imm, rax, v};
+}
+
+static Operand mem(RegisterID base, int64_t offset) {
+  return Operand{Operand::Mem, base, offset};
+}
+
+static Operand address(std::string_view label) {
+  return Operand{Operand::Address, rax, 0, label};
+}
+
+static std::string hex(const std::vector<uint8_t> &bytes) {
+  static const char digits[] = "0123456789abcdef";
+  std::string result;
+  for (uint8_t b : bytes) {
+    result += digits[b >> 4];
+    result += digits[b & 15];
+  }
+  return result;
+}
+
+// expected is what GNU as 2.40 assembles att to
+static void expect(const char* att, const std::string &expected, const std::function<void(X86Encoder&)> &emit) {
+  X86Encoder e;
+  emit(e);
+  std::string got = hex(e.code());
+  if (got != expected) {
+    std::cerr << att << ": expected " << expected << ", got " << got << std::endl;
+  }
+  L1_CHECK(got == expected);
+}
+
+static void moves() {
+  expect("movq %rdi, %rax", "4889f8", [](X86Encoder &e) { e.mov(reg(rax), reg(rdi)); });
+  expect("movq %rax, %r12", "4989c4", [](X86Encoder &e) { e.mov(reg(r12), reg(rax)); });
+  expect("movq %r13, %r8", "4d89e8", [](X86Encoder &e) { e.mov(reg(r8), reg(r13)); });
+  expect("movq $5, %rax", "48c7c005000000", [](X86Encoder &e) { e.mov(reg(rax), imm(5)); });
+  expect("movq $-1, %r11", "49c7c3ffffffff", [](X86Encoder &e) { e.mov(reg(r11), imm(-1)); });
+  expect("movabsq $81985529216486895, %rax", "48b8efcdab8967452301", [](X86Encoder &e) { e.mov(reg(rax), imm(0x123456789abcdef)); });
+  expect("movabsq $-4294967297, %r15", "49bffffffffffeffffff", [](X86Encoder &e) { e.mov(reg(r15), imm(-4294967297)); });
+}
+
+// rsp and r12 need a SIB byte, rbp and r13 a displacement even when it is 0
+static void memory_operands() {
+  expect("movq (%rsp), %rax", "488b0424", [](X86Encoder &e) { e.mov(reg(rax), mem(rsp, 0)); });
+  expect("movq 8(%rsp), %rdi", "488b7c2408", [](X86Encoder &e) { e.mov(reg(rdi), mem(rsp, 8)); });
+  expect("movq 1024(%rsp), %rdi", "488bbc2400040000", [](X86Encoder &e) { e.mov(reg(rdi), mem(rsp, 1024)); });
+  expect("movq (%r12), %rax", "498b0424", [](X86Encoder &e) { e.mov(reg(rax), mem(r12, 0)); });
+  expect("movq 16(%r12), %r9", "4d8b4c2410", [](X86Encoder &e) { e.mov(reg(r9), mem(r12, 16)); });
+  expect("movq (%r13), %rax", "498b4500", [](X86Encoder &e) { e.mov(reg(rax), mem(r13, 0)); });
+  expect("movq (%rbp), %rax", "488b4500", [](X86Encoder &e) { e.mov(reg(rax), mem(rbp, 0)); });
+  expect("movq -8(%rbp), %rax", "488b45f8", [](X86Encoder &e) { e.mov(reg(rax), mem(rbp, -8)); });
+  expect("movq %rdi, 8(%rsp)", "48897c2408", [](X86Encoder &e) { e.mov(mem(rsp, 8), reg(rdi)); });
+  expect("movq %r10, -16(%r12)", "4d895424f0", [](X86Encoder &e) { e.mov(mem(r12, -16), reg(r10)); });
+  expect("movq $7, 8(%rsp)", "48c744240807000000", [](X86Encoder &e) { e.mov(mem(rsp, 8), imm(7)); });
+  expect("movq %rax, 200(%rdx)", "488982c8000000", [](X86Encoder &e) { e.mov(mem(rdx, 200), reg(rax)); });
+}
+
+static void arithmetic() {
+  expect("addq %rdi, %rax", "4801f8", [](X86Encoder &e) { e.aop(AOP::plus_equal, reg(rax), reg(rdi)); });
+  expect("subq $1, %rax", "4883e801", [](X86Encoder &e) { e.aop(AOP::minus_equal, reg(rax), imm(1)); });
+  expect("andq $4096, %r13", "4981e500100000", [](X86Encoder &e) { e.aop(AOP::and_equal, reg(r13), imm(4096)); });
+  expect("addq %rax, 8(%rsp)", "4801442408", [](X86Encoder &e) { e.aop(AOP::plus_equal, mem(rsp, 8), reg(rax)); });
+  expect("subq 8(%rsp), %r14", "4c2b742408", [](X86Encoder &e) { e.aop(AOP::minus_equal, reg(r14), mem(rsp, 8)); });
+  expect("addq $3, 16(%r12)", "498344241003", [](X86Encoder &e) { e.aop(AOP::plus_equal, mem(r12, 16), imm(3)); });
+  expect("imulq %rsi, %rax", "480fafc6", [](X86Encoder &e) { e.aop(AOP::times_equal, reg(rax), reg(rsi)); });
+  expect("imulq $9, %r10", "4d6bd209", [](X86Encoder &e) { e.aop(AOP::times_equal, reg(r10), imm(9)); });
+  expect("imulq $1000, %rbx", "4869dbe8030000", [](X86Encoder &e) { e.aop(AOP::times_equal, reg(rbx), imm(1000)); });
+  expect("imulq 8(%rsp), %rdi", "480faf7c2408", [](X86Encoder &e) { e.aop(AOP::times_equal, reg(rdi), mem(rsp, 8)); });
+  expect("cmpq %rsi, %rdi", "4839f7", [](X86Encoder &e) { e.cmp(reg(rdi), reg(rsi)); });
+  expect("cmpq $10, %rax", "4883f80a", [](X86Encoder &e) { e.cmp(reg(rax), imm(10)); });
+  expect("cmpq $-200, %r9", "4981f938ffffff", [](X86Encoder &e) { e.cmp(reg(r9), imm(-200)); });
+  expect("incq %rax", "48ffc0", [](X86Encoder &e) { e.inc_dec(IncDec::increment, rax); });
+  expect("decq %r15", "49ffcf", [](X86Encoder &e) { e.inc_dec(IncDec::decrement, r15); });
+}
+
+static void shifts() {
+  expect("salq %cl, %rax", "48d3e0", [](X86Encoder &e) { e.sop(SOP::left_shift, rax, reg(rcx)); });
+  expect("sarq %cl, %r11", "49d3fb", [](X86Encoder &e) { e.sop(SOP::right_shift, r11, reg(rcx)); });
+  expect("salq $3, %rdi", "48c1e703", [](X86Encoder &e) { e.sop(SOP::left_shift, rdi, imm(3)); });
+  expect("sarq $63, %r12", "49c1fc3f", [](X86Encoder &e) { e.sop(SOP::right_shift, r12, imm(63)); });
+
+  bool thrown = false;
+  try {
+    X86Encoder e;
+    e.sop(SOP::left_shift, rax, reg(rdx));
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  L1_CHECK(thrown);
+}
+
+// dil and sil need an empty REX prefix, or they would be bh and dh
+static void comparisons() {
+  expect("setl %al", "0f9cc0", [](X86Encoder &e) { e.setcc(Less, rax); });
+  expect("setle %dil", "400f9ec7", [](X86Encoder &e) { e.setcc(LessEqual, rdi); });
+  expect("sete %r8b", "410f94c0", [](X86Encoder &e) { e.setcc(Equal, r8); });
+  expect("setg %sil", "400f9fc6", [](X86Encoder &e) { e.setcc(Greater, rsi); });
+  expect("setge %r15b", "410f9dc7", [](X86Encoder &e) { e.setcc(GreaterEqual, r15); });
+  expect("movzbq %al, %rax", "480fb6c0", [](X86Encoder &e) { e.movzbq(rax, rax); });
+  expect("movzbq %dil, %rdi", "480fb6ff", [](X86Encoder &e) { e.movzbq(rdi, rdi); });
+  expect("movzbq %r8b, %r8", "4d0fb6c0", [](X86Encoder &e) { e.movzbq(r8, r8); });
+}
+
+static void lea_and_stack() {
+  expect("leaq (%rax,%rdi,8), %rdx", "488d14f8", [](X86Encoder &e) { e.lea(rdx, rax, rdi, 8); });
+  expect("leaq (%rsp,%rsi,1), %r10", "4c8d1434", [](X86Encoder &e) { e.lea(r10, rsp, rsi, 1); });
+  expect("leaq (%r13,%r12,4), %rax", "4b8d44a500", [](X86Encoder &e) { e.lea(rax, r13, r12, 4); });
+  expect("leaq (%rbp,%rax,2), %r12", "4c8d644500", [](X86Encoder &e) { e.lea(r12, rbp, rax, 2); });
+  expect("jmp *%rax", "ffe0", [](X86Encoder &e) { e.jmp(rax); });
+  expect("jmp *%r10", "41ffe2", [](X86Encoder &e) { e.jmp(r10); });
+  expect("pushq %rbx", "53", [](X86Encoder &e) { e.push(rbx); });
+  expect("pushq %r12", "4154", [](X86Encoder &e) { e.push(r12); });
+  expect("popq %r15", "415f", [](X86Encoder &e) { e.pop(r15); });
+  expect("popq %rbp", "5d", [](X86Encoder &e) { e.pop(rbp); });
+  expect("retq", "c3", [](X86Encoder &e) { e.ret(); });
+}
+
+// A function with forward and backward jumps, a call, a runtime call and a label address
+static X86Encoder labeled_code() {
+  X86Encoder e;
+  e.define_label("go", true);
+  e.push(r12);
+  e.define_label("top");
+  e.jmp("end");
+  e.jcc(Less, "top");
+  e.call("f");
+  e.call_runtime("print");
+  e.mov(reg(rdi), address("top"));
+  e.define_label("f");
+  e.ret();
+  e.define_label("end");
+  e.ret();
+  e.resolve();
+  return e;
+}
+
+static void label_fixups() {
+  X86Encoder e = labeled_code();
+  // jmp +24 to end, jl -11 back to top, call +12 to f; the runtime call and the address stay zero
+  L1_CHECK(hex(e.code()) == "4154" "e918000000" "0f8cf5ffffff" "e80c000000" "e800000000" "48c7c700000000" "c3" "c3");
+
+  const auto &relocations = e.relocations();
+  L1_CHECK(relocations.size() == 2);
+  if (relocations.size() != 2) { return; }
+  L1_CHECK(relocations[0].offset == 19 && relocations[0].type == R_X86_64_PLT32);
+  L1_CHECK(relocations[0].symbol == "print" && relocations[0].addend == -4);
+  L1_CHECK(relocations[1].offset == 26 && relocations[1].type == R_X86_64_32S);
+  L1_CHECK(relocations[1].symbol.empty() && relocations[1].addend == 2);
+
+  bool thrown = false;
+  try {
+    X86Encoder missing;
+    missing.jmp("nowhere");
+    missing.resolve();
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  L1_CHECK(thrown);
+}
+
+template <typename T>
+static T read_at(const std::string &file, size_t offset) {
+  T value{};
+  if (offset + sizeof(T) <= file.size()) {
+    std::memcpy(&value, file.data() + offset, sizeof(T));
+  }
+  return value;
+}
+
+static void elf_object() {
+  X86Encoder e = labeled_code();
+  std::ostringstream out;
+  write_elf_object(out, e);
+  std::string file = out.str();
+
+  auto header = read_at<Elf64_Ehdr>(file, 0);
+  L1_CHECK(std::memcmp(header.e_ident, ELFMAG, SELFMAG) == 0);
+  L1_CHECK(header.e_ident[EI_CLASS] == ELFCLASS64 && header.e_type == ET_REL && header.e_machine == EM_X86_64);
+  L1_CHECK(header.e_shnum > 0 && header.e_shstrndx < header.e_shnum);
+  if (header.e_shnum == 0 || header.e_shstrndx >= header.e_shnum) { return; }
+
+  auto section_header = [&](size_t k) { return read_at<Elf64_Shdr>(file, header.e_shoff + k * sizeof(Elf64_Shdr)); };
+  auto shstrtab = section_header(header.e_shstrndx);
+  auto find = [&](const std::string &name) {
+    for (size_t k = 0; k < header.e_shnum; k++) {
+      auto s = section_header(k);
+      if (file.compare(shstrtab.sh_offset + s.sh_name, name.size() + 1, name.c_str(), name.size() + 1) == 0) {
+        return s;
+      }
+    }
+    return Elf64_Shdr{};
+  };
+
+  auto text = find(".text");
+  L1_CHECK(file.compare(text.sh_offset, text.sh_size, std::string(e.code().begin(), e.code().end())) == 0);
+
+  auto symtab = find(".symtab");
+  auto strtab = section_header(symtab.sh_link);
+  auto symbol = [&](size_t k) { return read_at<Elf64_Sym>(file, symtab.sh_offset + k * sizeof(Elf64_Sym)); };
+  auto name = [&](const Elf64_Sym &s) { return std::string(file.c_str() + strtab.sh_offset + s.st_name); };
+  // local labels keep the _ prefix prog.S gives them and come before the global ones
+  size_t symbols = symtab.sh_size / sizeof(Elf64_Sym);
+  std::string names;
+  for (size_t k = 1; k < symbols; k++) {
+    auto s = symbol(k);
+    bool global = ELF64_ST_BIND(s.st_info) == STB_GLOBAL;
+    L1_CHECK(global == (k >= symtab.sh_info));
+    names += name(s) + (s.st_shndx == SHN_UNDEF ? "? " : "@" + std::to_string(s.st_value) + " ");
+  }
+  L1_CHECK(names == "@0 _top@2 _f@30 _end@31 go@0 print? ");
+
+  auto rela = find(".rela.text");
+  // relocations for the text section, against the symbol table
+  L1_CHECK(section_header(rela.sh_info).sh_offset == text.sh_offset && section_header(rela.sh_link).sh_offset == symtab.sh_offset);
+  L1_CHECK(rela.sh_size == 2 * sizeof(Elf64_Rela));
+  auto call = read_at<Elf64_Rela>(file, rela.sh_offset);
+  L1_CHECK(call.r_offset == 19 && ELF64_R_TYPE(call.r_info) == R_X86_64_PLT32 && call.r_addend == -4);
+  L1_CHECK(name(symbol(ELF64_R_SYM(call.r_info))) == "print");
+  auto address = read_at<Elf64_Rela>(file, rela.sh_offset + sizeof(Elf64_Rela));
+  L1_CHECK(address.r_offset == 26 && ELF64_R_TYPE(address.r_info) == R_X86_64_32S && address.r_addend == 2);
+  L1_CHECK(ELF64_ST_TYPE(symbol(ELF64_R_SYM(address.r_info)).st_info) == STT_SECTION);
+}
+
+int main() {
+  moves();
+  memory_operands();
+  arithmetic();
+  shifts();
+  comparisons();
+  lea_and_stack();
+  label_fixups();
+  elf_object();
+  return test::failures;
+}
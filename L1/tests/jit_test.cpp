@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include <test.h>
+#include <jit.h>
+
+using namespace L1;
+
+// Allocates and prints an array, then doubles 4 and 8 in an L1 function, called
+// once by name and once through a register; each call returns to a label
+static const char* calls = R"((@main
+(@main
+0
+0
+  rdi <- 5
+  rsi <- 7
+  call allocate 2
+  rdi <- rax
+  call print 1
+  mem rsp -8 <- :by_name
+  rdi <- 9
+  call @double 1
+  :by_name
+  rdi <- rax
+  call print 1
+  mem rsp -8 <- :by_register
+  rdi <- 17
+  rdx <- @double
+  call rdx 1
+  :by_register
+  rdi <- rax
+  call print 1
+  return
+)
+(@double
+1
+0
+  rax <- rdi
+  rax += rdi
+  rax -= 1
+  return
+)
+)
+)";
+
+// What the program writes to stdout when run in this process, as -x does
+static std::string run(Program &p, size_t jobs) {
+  char path[] = "/tmp/l1_jit_test_XXXXXX";
+  int fd = mkstemp(path);
+  L1_CHECK(fd >= 0);
+  std::fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  dup2(fd, STDOUT_FILENO);
+  execute_program(p, jobs);
+  std::fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  close(fd);
+
+  std::ifstream in(path);
+  std::stringstream output;
+  output << in.rdbuf();
+  std::remove(path);
+  return output.str();
+}
+
+static void runtime_and_l1_calls() {
+  for (size_t jobs : {1, 2}) {
+    auto p = test::parse(calls);
+    L1_CHECK(run(p, jobs) == "{s:2, 3, 3}\n8\n16\n");
+  }
+}
+
+int main() {
+  runtime_and_l1_calls();
+  return test::failures;
+}
@@ -0,0 +1,62 @@
+#include <string>
+
+#include <test.h>
+#include <peephole.h>
+
+using namespace L1;
+
+// Wraps instructions in a one-function program with a stack slot
+static std::string program(const std::string &body) {
+  return "(@main\n(@main\n0\n1\n" + body + "  return\n)\n)\n";
+}
+
+// True if body comes out of the peephole pass as the code expected would generate
+static bool rewrites_to(const std::string &body, const std::string &expected) {
+  auto p = test::parse(program(body));
+  optimize_peephole(p);
+  auto q = test::parse(program(expected));
+  return test::generate(p) == test::generate(q);
+}
+
+static void self_move() {
+  L1_CHECK(rewrites_to("  rax <- rax\n  rdi <- rax\n", "  rdi <- rax\n"));
+}
+
+static void store_then_reload() {
+  L1_CHECK(rewrites_to("  mem rsp 0 <- rdi\n  rax <- mem rsp 0\n", "  mem rsp 0 <- rdi\n  rax <- rdi\n"));
+}
+
+static void arithmetic_identity() {
+  L1_CHECK(rewrites_to("  rax += 0\n  rax -= 0\n  rax *= 1\n  rax &= -1\n  rax <<= 0\n  rax >>= 0\n  rax += 1\n", "  rax += 1\n"));
+}
+
+static void jump_to_next_instruction() {
+  L1_CHECK(rewrites_to("  goto :next\n  :next\n", "  :next\n"));
+  L1_CHECK(rewrites_to("  cjump rax < rdi :next\n  :next\n", "  :next\n"));
+}
+
+// The reload becomes rax <- rax, which the self move rule then deletes
+static void chained_rewrites() {
+  L1_CHECK(rewrites_to("  mem rsp 0 <- rax\n  rax <- mem rsp 0\n  rdi <- rax\n", "  mem rsp 0 <- rax\n  rdi <- rax\n"));
+}
+
+static void rules_that_must_not_fire() {
+  // the jump skips an instruction
+  const std::string skip = "  cjump rax < rdi :far\n  rax <- 1\n  :far\n";
+  L1_CHECK(rewrites_to(skip, skip));
+  // same offset, different base: rdi may not point at the slot
+  const std::string otherBase = "  mem rsp 0 <- rdi\n  rax <- mem rdi 0\n";
+  L1_CHECK(rewrites_to(otherBase, otherBase));
+  const std::string notIdentities = "  rax += 1\n  rax *= 0\n  rax &= 1\n  rax <<= 1\n  rdi <- rax\n";
+  L1_CHECK(rewrites_to(notIdentities, notIdentities));
+}
+
+int main() {
+  self_move();
+  store_then_reload();
+  arithmetic_identity();
+  jump_to_next_instruction();
+  chained_rewrites();
+  rules_that_must_not_fire();
+  return test::failures;
+}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Builds every *_test.cpp here against the compiler sources (all but compiler.cpp) and runs it.
+# PEGTL_INCLUDE names PEGTL's include directory; CXX and CXXFLAGS are honored.
+set -e
+tests=$(cd "$(dirname "$0")" && pwd)
+src=$tests/../src
+build=${BUILD_DIR:-$tests/build}
+pegtl=${PEGTL_INCLUDE:?set PEGTL_INCLUDE to PEGTL\'s include directory}
+cxx=${CXX:-g++}
+flags="-std=c++17 -O1 -g -Wall $CXXFLAGS"
+
+mkdir -p "$build"
+objects=()
+for f in "$src"/*.cpp; do
+  [ "$(basename "$f")" = compiler.cpp ] && continue
+  o=$build/$(basename "$f" .cpp).o
+  if [ ! -e "$o" ] || [ "$f" -nt "$o" ] || [ -n "$(find "$src" -name '*.h' -newer "$o")" ]; then
+    $cxx $flags -I"$src" -I"$pegtl" -c "$f" -o "$o"
+  fi
+  objects+=("$o")
+done
+
+failed=0
+for t in "$tests"/*_test.cpp; do
+  name=$(basename "$t" .cpp)
+  $cxx $flags -I"$src" -I"$pegtl" -I"$tests" "$t" "${objects[@]}" -o "$build/$name" -lpthread
+  if (cd "$build" && "./$name"); then
+    echo "PASS $name"
+  else
+    echo "FAIL $name"
+    failed=1
+  fi
+done
+exit $failed
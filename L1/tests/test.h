@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include <L1.h>
+#include <parser.h>
+#include <code_generator.h>
+
+// Checks shared by the tests in this directory; a test's main returns L1::test::failures
+#define L1_CHECK(condition) \
+  ::L1::test::check((condition), #condition, __FILE__, __LINE__)
+
+namespace L1::test {
+
+  inline int failures = 0;
+
+  inline void check(bool ok, const char* what, const char* file, int line) {
+    if (!ok) {
+      std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+      failures++;
+    }
+  }
+
+  // The L1 parser only reads files, so the source goes through a temporary one
+  inline Program parse(const std::string &source) {
+    char path[] = "/tmp/l1_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+      throw std::runtime_error("cannot create a temporary file");
+    }
+    close(fd);
+    std::ofstream(path) << source;
+    Program p = parse_file(path);
+    std::remove(path);
+    return p;
+  }
+
+  // Returns the assembly -g would write to prog.S
+  inline std::string generate(Program &p) {
+    std::ostringstream out;
+    CodeGenBehavior b(out);
+    p.accept(b);
+    return out.str();
+  }
+}
@@ -1,4 +1,4 @@
-#include <sstream> 
+#include <string_view> 
 
 #include <L2.h>
 #include <liveness_analysis.h> 
@@ -16,22 +16,42 @@ Number::Number (int64_t n)
   : number {n}{
     return ; 
   }
+
+Register* canonical_register(RegisterID r) {
+  static Register registers[] = {rdi, rsi, rdx, rcx, r8, r9, rax, rbx, rbp, r10, r11, r12, r13, r14, r15, rsp}; 
+  return &registers[r]; 
+}
+
+Number* make_number(Arena &arena, int64_t n) {
+  static const int64_t smallMin = -16, smallMax = 1024; 
+  static std::vector<Number> smallNumbers = [] {
+    std::vector<Number> v; 
+    for (int64_t i = smallMin; i <= smallMax; i++) {
+      v.emplace_back(i); 
+    }
+    return v; 
+  }(); 
+  if (n >= smallMin && n <= smallMax) {
+    return &smallNumbers[n - smallMin]; 
+  }
+  return arena.make<Number>(n); 
+}
   
 int64_t Number::value() const {
   return number; 
 }
 
-Label::Label (const std::string &s)
+Label::Label (Symbol s)
   : label {s} {
     return; 
   }
 
-Func::Func (const std::string &s)
+Func::Func (Symbol s)
   : function_label {s} {
     return; 
   }
 
-Variable::Variable(const std::string &s)
+Variable::Variable(Symbol s)
   : var (s) {
     return; 
   }
@@ -74,6 +94,26 @@ ItemType Memory::kind() const {
   return ItemType::MemoryItem; 
 }
 
+RegisterID Register::id() const {
+  return ID; 
+}
+
+Symbol Label::symbol() const {
+  return label; 
+}
+
+Symbol Func::symbol() const {
+  return function_label; 
+}
+
+Symbol Variable::symbol() const {
+  return var; 
+}
+
+Number* StackArg::getOffset() const {
+  return offset; 
+}
+
 Item* Memory::getVar() const {
   return var;
 }
@@ -82,79 +122,66 @@ Number* Memory::getOffset() const {
   return offset; 
 }
 
-std::string Register::emit (const EmitOptions& options) const {
-  std::ostringstream s; 
-  std::string reg = options.eightBitRegister ? eightBitReg_assembly_from_register(ID) : options.indirectRegCall ? indirect_call_reg_assembly_from_register(ID) : options.livenessAnalysis || options.l2tol1 ? string_from_register(ID) : assembly_from_register(ID); 
-  s << reg; 
-  return s.str(); 
+std::string Item::emit(const EmitOptions& options) const {
+  Emitter e; 
+  emit_to(e, options); 
+  return e.str(); 
 }
 
-std::string Number::emit(const EmitOptions& options) const {
-  std::string nString = std::to_string(number); 
-  if (options.l2tol1) {
-    return nString; 
+void Register::emit_to(Emitter& e, const EmitOptions& options) const {
+  e << (options.eightBitRegister ? eightBitReg_assembly_from_register(ID) : options.indirectRegCall ? indirect_call_reg_assembly_from_register(ID) : options.livenessAnalysis || options.l2tol1 ? string_from_register(ID) : assembly_from_register(ID)); 
+}
+
+void Number::emit_to(Emitter& e, const EmitOptions& options) const {
+  if (!options.l2tol1) {
+    e << '$'; 
   }
-  std::ostringstream s; 
-  s << "$" << nString;
-  return s.str(); 
+  e << number; 
 }
 
-std::string Label::emit(const EmitOptions& options) const {
+void Label::emit_to(Emitter& e, const EmitOptions& options) const {
+  std::string_view lname = symbol_name(label); 
   if (options.l2tol1) {
-    return label; 
+    e << lname; 
+    return; 
   }
-  std::string lname = label.substr(1); 
-  std::ostringstream s; 
-  std::string prefix = options.memoryStoredLabel ? "$_" : "_"; 
-  s << prefix << lname;
-  return s.str(); 
+  e << (options.memoryStoredLabel ? "$_" : "_") << lname.substr(1); 
 }
 
-std::string Func::emit(const EmitOptions& options) const {
+void Func::emit_to(Emitter& e, const EmitOptions& options) const {
+  std::string_view fname = symbol_name(function_label); 
   if (options.l2tol1) {
-    return function_label; 
-  }
-  std::string fname = function_label.substr(1); 
-  std::ostringstream s; 
-  if (options.functionCall) {
-    s << "_" << fname; 
-  } else {
-    s << "$_" << fname; 
+    e << fname; 
+    return; 
   }
-  return s.str(); 
+  e << (options.functionCall ? "_" : "$_") << fname.substr(1); 
 }
 
-std::string Variable::emit(const EmitOptions& options) const {
+void Variable::emit_to(Emitter& e, const EmitOptions& options) const {
   if (options.l2tol1) {
     auto it = options.coloring->find(var); 
     if (it != options.coloring->end()) {
-      return it->second; 
+      e << string_from_register(it->second); 
+      return; 
     }
   }
-  return var; 
+  e << symbol_name(var); 
 }
 
-std::string StackArg::emit(const EmitOptions& options) const {
-  return "";
-}
+void StackArg::emit_to(Emitter& e, const EmitOptions& options) const {}
 
-std::string Memory::emit(const EmitOptions& options) const {
+void Memory::emit_to(Emitter& e, const EmitOptions& options) const {
   if (options.l2tol1) {
-    std::ostringstream s; 
-    s << "mem " << var->emit(options) << " " << offset->emit().substr(1); 
-    return s.str(); 
+    e << "mem " << emitted(var, options) << ' ' << offset->value(); 
+    return; 
   }
 
   if (options.livenessAnalysis) {
-    return var->emit(options); 
+    var->emit_to(e, options); 
+    return; 
   }
-  
-  std::string offsetString = offset->emit().substr(1);
-  std::string regString = var->emit();
-  
-  std::ostringstream s; 
-  s << offsetString << "(" << regString << ")"; 
-  return s.str(); 
+
+  e << offset->value() << '(' << emitted(var) << ')'; 
 }
 
 
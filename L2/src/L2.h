@@ -6,6 +6,10 @@
 #include <cstdint>
 #include <iostream>
 
+#include <arena.h>
+#include <emitter.h>
+#include <symbol.h>
+
 
 
 
@@ -40,21 +44,39 @@ namespace L2 {
     bool indirectRegCall = false; 
     bool livenessAnalysis = false; 
 
-    const std::unordered_map<std::string, std::string>* coloring = nullptr; 
+    const std::unordered_map<Symbol, RegisterID>* coloring = nullptr; 
   }; 
 
   class Item {
     public: 
-      virtual ~Item() = default; 
-      virtual std::string emit(const EmitOptions& options = EmitOptions{}) const = 0; 
+      // No virtual destructor: items live in the program's arena and are never deleted one by one
+      // Appends the item's text to e; emit() returns the same text as a string
+      virtual void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const = 0; 
+      std::string emit(const EmitOptions& options = EmitOptions{}) const; 
       virtual ItemType kind() const = 0; 
   };
 
+  // Lets code generators chain items: out << emitted(item, options)
+  struct Emitted {
+    const Item* item; 
+    EmitOptions options; 
+  }; 
+
+  inline Emitted emitted(const Item* item, const EmitOptions& options = EmitOptions{}) {
+    return Emitted{item, options}; 
+  }
+
+  inline Emitter& operator<<(Emitter& e, const Emitted& x) {
+    x.item->emit_to(e, x.options); 
+    return e; 
+  }
+
   class Register : public Item {
     public:
       Register (RegisterID r);
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override;
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
+      RegisterID id() const; 
 
     private:
       RegisterID ID;
@@ -63,7 +85,7 @@ namespace L2 {
   class Number : public Item {
     public:
       Number (int64_t n); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override;
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       int64_t value() const; 
       ItemType kind() const override; 
 
@@ -74,40 +96,45 @@ namespace L2 {
 
   class Label : public Item {
     public: 
-      Label (const std::string &s); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override;
+      Label (Symbol s); 
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
+      Symbol symbol() const; 
 
     private: 
-      std::string label; 
+      Symbol label; 
   }; 
 
   class Func : public Item {
     public: 
-      Func (const std::string &s); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override;
+      Func (Symbol s); 
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
+      Symbol symbol() const; 
 
     private: 
-      std::string function_label; 
+      Symbol function_label; 
   }; 
 
   class Variable : public Item {
     public: 
-      Variable (const std::string &s); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override; 
+      Variable (Symbol s); 
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
+      Symbol symbol() const; 
 
     private: 
-      std::string var; 
+      Symbol var; 
   }; 
 
   class StackArg : public Item {
     public: 
       StackArg (Number* n); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override; 
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
 
+      Number* getOffset() const; 
+
     private: 
       Number* offset; 
   };
@@ -115,7 +142,7 @@ namespace L2 {
   class Memory : public Item {
     public: 
       Memory (Item *v, Number *n); 
-      std::string emit(const EmitOptions& options = EmitOptions{}) const override;
+      void emit_to(Emitter& e, const EmitOptions& options = EmitOptions{}) const override;
       ItemType kind() const override; 
 
       Item* getVar() const; 
@@ -130,12 +157,16 @@ namespace L2 {
 
 
 
+  // Shared items: one Register per RegisterID and one Number per small constant
+  Register* canonical_register(RegisterID r); 
+  Number* make_number(Arena &arena, int64_t n); 
+
   /*
    * Instruction interface.
    */
   class Instruction{
     public: 
-      virtual ~Instruction() = default; 
+      // Arena-owned like items, see Item
       void virtual accept(Behavior& b) = 0; 
   };
 
@@ -349,6 +380,15 @@ namespace L2 {
       public:
         std::string entryPointLabel;
         std::vector<Function *> functions;
+
+        // Owns every function, instruction and item of the program
+        Arena arena;
+
+        Program() = default;
+        Program(Program&&) = default;
+        Program& operator=(Program&&) = default;
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
         
         void accept(Behavior& b); 
     };
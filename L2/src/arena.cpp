@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cstdint>
+
+#include <arena.h>
+
+namespace L2 {
+
+  static const size_t blockSize = 64 * 1024;
+
+  Arena::Arena(Arena&& other) noexcept
+    : blocks(std::move(other.blocks)), cur(other.cur), end(other.end), finalizers(std::move(other.finalizers)) {
+      other.blocks.clear();
+      other.finalizers.clear();
+      other.cur = other.end = nullptr;
+    }
+
+  Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+      release();
+      blocks = std::move(other.blocks);
+      finalizers = std::move(other.finalizers);
+      cur = other.cur;
+      end = other.end;
+      other.blocks.clear();
+      other.finalizers.clear();
+      other.cur = other.end = nullptr;
+    }
+    return *this;
+  }
+
+  Arena::~Arena() {
+    release();
+  }
+
+  void Arena::release() {
+    for (auto it = finalizers.rbegin(); it != finalizers.rend(); ++it) {
+      it->second(it->first);
+    }
+    finalizers.clear();
+    blocks.clear();
+    cur = end = nullptr;
+  }
+
+  void Arena::adopt(Arena&& other) {
+    for (auto& b : other.blocks) {
+      blocks.push_back(std::move(b));
+    }
+    finalizers.insert(finalizers.end(), other.finalizers.begin(), other.finalizers.end());
+    other.blocks.clear();
+    other.finalizers.clear();
+    other.cur = other.end = nullptr;
+  }
+
+  void* Arena::allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(uintptr_t(align) - 1);
+    if (cur == nullptr || p + size > reinterpret_cast<uintptr_t>(end)) {
+      // oversized requests get a block of their own
+      size_t n = std::max(blockSize, size + align);
+      blocks.emplace_back(new char[n]);
+      cur = blocks.back().get();
+      end = cur + n;
+      p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(uintptr_t(align) - 1);
+    }
+    cur = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+  }
+}
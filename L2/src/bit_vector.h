@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace L2 {
+
+  /*
+   * Dense set of small integer IDs, stored one bit per ID in 64-bit words.
+   * Union, difference and equality work a whole word at a time.
+   */
+  class BitVector {
+    public:
+      BitVector() = default;
+      explicit BitVector(size_t n)
+        : bits(n), words((n + 63) / 64, 0) {}
+
+      size_t size() const { return bits; }
+
+      void resize(size_t n) {
+        bits = n;
+        words.resize((n + 63) / 64, 0);
+      }
+
+      void clear() {
+        std::fill(words.begin(), words.end(), 0);
+      }
+
+      // Grows the vector if i is past the end.
+      void set(size_t i) {
+        if (i >= bits) resize(i + 1);
+        words[i / 64] |= uint64_t{1} << (i % 64);
+      }
+
+      void reset(size_t i) {
+        if (i < bits) words[i / 64] &= ~(uint64_t{1} << (i % 64));
+      }
+
+      bool test(size_t i) const {
+        return i < bits && (words[i / 64] >> (i % 64)) & 1;
+      }
+
+      size_t count() const {
+        size_t n = 0;
+        for (uint64_t w : words) {
+          n += __builtin_popcountll(w);
+        }
+        return n;
+      }
+
+      bool empty() const {
+        for (uint64_t w : words) {
+          if (w) return false;
+        }
+        return true;
+      }
+
+      // this |= other
+      void union_with(const BitVector& other) {
+        for (size_t w = 0; w < words.size(); w++) {
+          words[w] |= other.words[w];
+        }
+      }
+
+      // this = gen | (out & ~kill); returns true if this changed
+      bool assign_gen_out_kill(const BitVector& gen, const BitVector& out, const BitVector& kill) {
+        bool changed = false;
+        for (size_t w = 0; w < words.size(); w++) {
+          uint64_t v = gen.words[w] | (out.words[w] & ~kill.words[w]);
+          changed |= v != words[w];
+          words[w] = v;
+        }
+        return changed;
+      }
+
+      bool operator==(const BitVector& other) const { return words == other.words; }
+      bool operator!=(const BitVector& other) const { return words != other.words; }
+
+      // Calls f(id) for every set bit, in increasing ID order.
+      template <typename F>
+      void for_each(F f) const {
+        for (size_t w = 0; w < words.size(); w++) {
+          uint64_t v = words[w];
+          while (v) {
+            f(w * 64 + __builtin_ctzll(v));
+            v &= v - 1;
+          }
+        }
+      }
+
+    private:
+      size_t bits = 0;
+      std::vector<uint64_t> words;
+  };
+}
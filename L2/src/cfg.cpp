@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstdint>
+
+#include <cfg.h>
+
+namespace L2 {
+
+  void CFGBuilderBehavior::act(Program &p) {
+    for (Function* f: p.functions) {
+      f->accept(*this);
+    }
+  }
+
+  void CFGBuilderBehavior::act(Function &f) {
+    flow.reserve(f.instructions.size());
+    for (Instruction* i: f.instructions) {
+      isLabel.push_back(false);
+      targets.emplace_back();
+      flow.push_back(FallThrough);
+      i->accept(*this);
+    }
+  }
+
+  void CFGBuilderBehavior::addressTaken(const Item* item) {
+    if (item->kind() == ItemType::LabelItem) {
+      takenLabels.push_back(static_cast<const Label*>(item)->symbol());
+    }
+  }
+
+  void CFGBuilderBehavior::act(Instruction_assignment &i) {
+    addressTaken(i.src());
+  }
+
+  void CFGBuilderBehavior::act(Instruction_stack_arg_assignment &i) {}
+  void CFGBuilderBehavior::act(Instruction_aop &i) {}
+  void CFGBuilderBehavior::act(Instruction_sop &i) {}
+  void CFGBuilderBehavior::act(Instruction_mem_aop &i) {}
+  void CFGBuilderBehavior::act(Instruction_cmp_assignment &i) {}
+  void CFGBuilderBehavior::act(Instruction_reg_inc_dec &i) {}
+  void CFGBuilderBehavior::act(Instruction_lea &i) {}
+
+  void CFGBuilderBehavior::act(Instruction_cjump &i) {
+    flow.back() = Branch;
+    targets.back() = i.label()->symbol();
+  }
+
+  void CFGBuilderBehavior::act(Instruction_label &i) {
+    isLabel.back() = true;
+    labelIndex[i.label()->symbol()] = flow.size() - 1;
+  }
+
+  void CFGBuilderBehavior::act(Instruction_goto &i) {
+    flow.back() = Jump;
+    targets.back() = i.label()->symbol();
+  }
+
+  void CFGBuilderBehavior::act(Instruction_ret &i) {
+    flow.back() = Exit;
+  }
+
+  void CFGBuilderBehavior::act(Instruction_call &i) {
+    if (i.callee()) addressTaken(i.callee());
+    if (i.callType() == CallType::tuple_error || i.callType() == CallType::tensor_error) {
+      flow.back() = Exit;
+    }
+  }
+
+  CFG CFGBuilderBehavior::build() {
+    CFG cfg;
+    auto& blocks = cfg.blocks;
+    cfg.blockOf.assign(flow.size(), 0);
+
+    // A new block starts at every label and after every jump, branch or exit
+    bool leader = true;
+    for (size_t j = 0; j < flow.size(); j++) {
+      if (leader || isLabel[j]) {
+        blocks.push_back(BasicBlock{j, j, {}, {}});
+        leader = false;
+      }
+      blocks.back().last = j;
+      cfg.blockOf[j] = blocks.size() - 1;
+      leader = flow[j] != FallThrough;
+    }
+
+    auto add_edge = [&](size_t from, size_t to) {
+      blocks[from].succs.push_back(to);
+      blocks[to].preds.push_back(from);
+    };
+    auto label_block = [&](Symbol label) -> long {
+      auto it = labelIndex.find(label);
+      return it == labelIndex.end() ? -1 : static_cast<long>(cfg.blockOf[it->second]);
+    };
+    for (size_t b = 0; b < blocks.size(); b++) {
+      size_t last = blocks[b].last;
+      bool has_next = b + 1 < blocks.size();
+      if (flow[last] == Jump || flow[last] == Branch) {
+        long target = label_block(targets[last]);
+        if (target >= 0) add_edge(b, target);
+      }
+      if ((flow[last] == FallThrough || flow[last] == Branch) && has_next) {
+        add_edge(b, b + 1);
+      }
+    }
+
+    // Mark what can run: the entry block plus anything an address-taken label leads to
+    cfg.reachable.assign(blocks.size(), false);
+    auto& roots = cfg.roots;
+    if (!blocks.empty()) roots.push_back(0);
+    for (Symbol label : takenLabels) {
+      long target = label_block(label);
+      if (target >= 0) roots.push_back(target);
+    }
+    std::vector<size_t> stack = roots;
+    while (!stack.empty()) {
+      size_t b = stack.back();
+      stack.pop_back();
+      if (cfg.reachable[b]) continue;
+      cfg.reachable[b] = true;
+      for (size_t s : blocks[b].succs) {
+        stack.push_back(s);
+      }
+    }
+    cfg.find_loops();
+    cfg.flow = std::move(flow);
+    cfg.isLabel = std::move(isLabel);
+    return cfg;
+  }
+
+  std::vector<size_t> CFG::post_order() const {
+    std::vector<size_t> order;
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<std::pair<size_t, size_t>> dfs;
+    for (size_t root = 0; root < blocks.size(); root++) {
+      if (visited[root]) continue;
+      visited[root] = true;
+      dfs.push_back({root, 0});
+      while (!dfs.empty()) {
+        auto& [b, next] = dfs.back();
+        if (next < blocks[b].succs.size()) {
+          size_t s = blocks[b].succs[next++];
+          if (!visited[s]) {
+            visited[s] = true;
+            dfs.push_back({s, 0});
+          }
+        } else {
+          order.push_back(b);
+          dfs.pop_back();
+        }
+      }
+    }
+    return order;
+  }
+
+  /*
+   * Dominators come from the iterative algorithm of Cooper, Harvey and Kennedy
+   * over reverse post order, with index n as a virtual root above every root.
+   * An edge into a block that dominates its source is a back edge.
+   */
+  void CFG::find_loops() {
+    size_t n = blocks.size();
+    loops.clear();
+    loopDepth.assign(n, 0);
+
+    std::vector<size_t> order;
+    std::vector<long> number(n + 1, -1);
+    std::vector<std::pair<size_t, size_t>> dfs;
+    for (size_t root : roots) {
+      if (number[root] >= 0) continue;
+      number[root] = 0;
+      dfs.push_back({root, 0});
+      while (!dfs.empty()) {
+        auto& [b, next] = dfs.back();
+        if (next < blocks[b].succs.size()) {
+          size_t s = blocks[b].succs[next++];
+          if (number[s] < 0) {
+            number[s] = 0;
+            dfs.push_back({s, 0});
+          }
+        } else {
+          order.push_back(b);
+          dfs.pop_back();
+        }
+      }
+    }
+    std::reverse(order.begin(), order.end());
+    number[n] = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      number[order[i]] = i + 1;
+    }
+
+    const size_t none = SIZE_MAX;
+    std::vector<size_t> idom(n + 1, none);
+    idom[n] = n;
+    std::vector<bool> isRoot(n, false);
+    for (size_t root : roots) {
+      isRoot[root] = true;
+    }
+    auto intersect = [&](size_t a, size_t b) {
+      while (a != b) {
+        while (number[a] > number[b]) a = idom[a];
+        while (number[b] > number[a]) b = idom[b];
+      }
+      return a;
+    };
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t b : order) {
+        size_t d = isRoot[b] ? n : none;
+        for (size_t p : blocks[b].preds) {
+          if (idom[p] == none) continue;
+          d = d == none ? p : intersect(d, p);
+        }
+        if (d != idom[b]) {
+          idom[b] = d;
+          changed = true;
+        }
+      }
+    }
+    auto dominates = [&](size_t a, size_t b) {
+      while (b != a && b != n) b = idom[b];
+      return b == a;
+    };
+
+    std::vector<long> loopOf(n, -1);
+    for (size_t b : order) {
+      for (size_t h : blocks[b].succs) {
+        if (!dominates(h, b)) continue;
+        if (loopOf[h] < 0) {
+          loopOf[h] = loops.size();
+          loops.push_back(Loop{h, {h}});
+        }
+        Loop& loop = loops[loopOf[h]];
+        // the body is whatever reaches b without going through the header
+        std::vector<bool> inLoop(n, false);
+        for (size_t x : loop.blocks) inLoop[x] = true;
+        std::vector<size_t> work;
+        if (!inLoop[b]) {
+          inLoop[b] = true;
+          loop.blocks.push_back(b);
+          work.push_back(b);
+        }
+        while (!work.empty()) {
+          size_t x = work.back();
+          work.pop_back();
+          for (size_t p : blocks[x].preds) {
+            if (inLoop[p] || number[p] < 0) continue;
+            inLoop[p] = true;
+            loop.blocks.push_back(p);
+            work.push_back(p);
+          }
+        }
+      }
+    }
+    for (auto& loop : loops) {
+      std::sort(loop.blocks.begin(), loop.blocks.end());
+      for (size_t b : loop.blocks) {
+        loopDepth[b]++;
+      }
+    }
+  }
+
+  CFG build_cfg(Function &f) {
+    CFGBuilderBehavior b;
+    f.accept(b);
+    return b.build();
+  }
+}
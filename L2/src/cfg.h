@@ -0,0 +1,87 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <L2.h>
+#include <behavior.h>
+
+namespace L2 {
+
+  // How control leaves an instruction
+  enum FlowKind { FallThrough, Jump, Branch, Exit };
+
+  struct BasicBlock {
+    size_t first;
+    size_t last;
+    std::vector<size_t> succs;
+    std::vector<size_t> preds;
+  };
+
+  // Natural loop: the header and every block that reaches a back edge into it
+  struct Loop {
+    size_t header;
+    std::vector<size_t> blocks;
+  };
+
+  /*
+   * Control-flow graph of one function. Blocks are in instruction order and
+   * successors/predecessors are block indices, so analyses never look at labels.
+   */
+  class CFG {
+    public:
+      std::vector<BasicBlock> blocks;
+      std::vector<size_t> blockOf;
+      // Per instruction
+      std::vector<FlowKind> flow;
+      std::vector<bool> isLabel;
+
+      // The entry block and the blocks of labels whose address is taken
+      std::vector<size_t> roots;
+
+      // Reachable from the entry or from a label whose address is taken
+      std::vector<bool> reachable;
+
+      // Back edges into the same header make one loop; loopDepth counts the loops around each block
+      std::vector<Loop> loops;
+      std::vector<size_t> loopDepth;
+
+      std::vector<size_t> post_order() const;
+      void find_loops();
+  };
+
+  /*
+   * Classifies every instruction once; build_cfg turns the result into blocks.
+   */
+  class CFGBuilderBehavior : public Behavior {
+    public:
+      void act(Program &p) override;
+      void act(Function &f) override;
+      virtual void act(Instruction_assignment &i) override;
+      virtual void act(Instruction_stack_arg_assignment &i) override;
+      virtual void act(Instruction_aop &i) override;
+      virtual void act(Instruction_sop &i) override;
+      virtual void act(Instruction_mem_aop &i) override;
+      virtual void act(Instruction_cmp_assignment &i) override;
+      virtual void act(Instruction_cjump &i) override;
+      virtual void act(Instruction_label &i) override;
+      virtual void act(Instruction_goto &i) override;
+      virtual void act(Instruction_ret &i) override;
+      virtual void act(Instruction_call &i) override;
+      virtual void act(Instruction_reg_inc_dec &i) override;
+      virtual void act(Instruction_lea &i) override;
+
+      CFG build();
+
+    private:
+      void addressTaken(const Item* item);
+
+      std::vector<FlowKind> flow;
+      std::vector<bool> isLabel;
+      std::vector<Symbol> targets;
+      std::unordered_map<Symbol, size_t> labelIndex;
+      std::vector<Symbol> takenLabels;
+  };
+
+  CFG build_cfg(Function &f);
+}
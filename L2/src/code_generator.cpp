@@ -4,24 +4,32 @@
 
 #include <code_generator.h>
 #include <helper.h> 
+#include <trace.h>
 
 using namespace std;
 
 namespace L2{
-  CodeGenBehavior::CodeGenBehavior(std::ofstream &out, const std::unordered_map<std::string, std::string> &colorInputs, size_t locals)
-    : out(out), colorInputs(colorInputs), locals(locals) {
+  CodeGenBehavior::CodeGenBehavior(std::ostream &stream, const std::vector<functionAllocation> &allocations)
+    : allocations(allocations), stream(stream) {
       return; 
     }
  
   void CodeGenBehavior::act(Program &p) {
     out << "(" << p.entryPointLabel << "\n"; 
-    for (Function* f: p.functions) {
-      f->accept(*this);
+    for (cur_f = 0; cur_f < p.functions.size(); cur_f++) {
+      colorInputs = &allocations[cur_f].coloring; 
+      locals = allocations[cur_f].locals; 
+      p.functions[cur_f]->accept(*this);
+      if (out.size() >= flushSize) {
+        out.flush(stream); 
+      }
     }
     out << ")";
+    out.flush(stream); 
   }
 
   void CodeGenBehavior::act(Function& f) {
+    L2_TRACE(TraceCodegen, "codegen " << f.name << ": " << f.instructions.size() << " instructions, " << locals << " locals"); 
     out << "  (" << f.name << "\n"; 
     out << f.arguments << " " << locals << "\n";
     for (Instruction* i: f.instructions) {
@@ -30,66 +38,87 @@ namespace L2{
     out << "  )";   
   }
 
+  long CodeGenBehavior::register_of(const Item* item) const {
+    if (item->kind() == ItemType::RegisterItem) {
+      return static_cast<const Register*>(item)->id(); 
+    }
+    if (item->kind() == ItemType::VariableItem) {
+      auto it = colorInputs->find(static_cast<const Variable*>(item)->symbol()); 
+      return it == colorInputs->end() ? -1 : static_cast<long>(it->second); 
+    }
+    return -1; 
+  }
+
   void CodeGenBehavior::act(Instruction_assignment &i) { // w <- s | w <- mem x M | mem x M <- s |
+    // coalesced copies end up moving a register to itself
+    long dst = register_of(i.dst()); 
+    if (dst >= 0 && dst == register_of(i.src())) {
+      return; 
+    }
 
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs; 
-    out << "  " << i.dst()->emit(options) << " <- " << i.src()->emit(options) << "\n";
+    options.coloring = colorInputs; 
+    out << "  " << emitted(i.dst(), options) << " <- " << emitted(i.src(), options) << "\n";
 
   }
 
-  void CodeGenBehavior::act(Instruction_stack_arg_assignment &i) {
-
+  void CodeGenBehavior::act(Instruction_stack_arg_assignment &i) { // w <- stack-arg M
+    EmitOptions options; 
+    options.l2tol1 = true; 
+    options.coloring = colorInputs; 
+    // stack arguments sit above the locals
+    int64_t offset = locals * 8 + i.src()->getOffset()->value(); 
+    out << "  " << emitted(i.dst(), options) << " <- mem rsp " << offset << "\n"; 
   }
 
   void CodeGenBehavior::act(Instruction_aop &i) { // w aop t
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.dst()->emit(options) << " " << string_from_aop(i.aop()) << " " << i.rhs()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.dst(), options) << " " << string_from_aop(i.aop()) << " " << emitted(i.rhs(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_sop &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.dst()->emit(options) << " " << string_from_sop(i.sop()) << " " << i.src()->emit(options) << "\n";
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.dst(), options) << " " << string_from_sop(i.sop()) << " " << emitted(i.src(), options) << "\n";
   } 
 
   void CodeGenBehavior::act(Instruction_mem_aop &i) { // mem x M += t | mem x M -= t | w += mem x M | w -= mem x M |
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.lhs()->emit(options) << " " << string_from_aop(i.aop()) << " " << i.rhs()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.lhs(), options) << " " << string_from_aop(i.aop()) << " " << emitted(i.rhs(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_cmp_assignment &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.dst()->emit(options) << " <- " << i.lhs()->emit(options) << " cmp " << i.rhs()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.dst(), options) << " <- " << emitted(i.lhs(), options) << " " << string_from_cmp(i.cmp()) << " " << emitted(i.rhs(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_cjump &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << "cjump " << i.lhs()->emit(options) << " cmp " << i.rhs()->emit(options) << " " << i.label()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << "cjump " << emitted(i.lhs(), options) << " " << string_from_cmp(i.cmp()) << " " << emitted(i.rhs(), options) << " " << emitted(i.label(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_label &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.label()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.label(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_goto &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  goto " << i.label()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  goto " << emitted(i.label(), options) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_ret &i) {
@@ -99,9 +128,9 @@ namespace L2{
   void CodeGenBehavior::act(Instruction_call &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
+    options.coloring = colorInputs;
     if (i.callType() == l1) {
-      out << "  call " << i.callee()->emit(options) << " " << i.nArgs()->emit(options) << "\n"; 
+      out << "  call " << emitted(i.callee(), options) << " " << emitted(i.nArgs(), options) << "\n"; 
     } else if (i.callType() == print) {
       out << "  call print 1\n"; 
     } else if (i.callType() == allocate) {
@@ -109,7 +138,7 @@ namespace L2{
     } else if (i.callType() == input) {
       out << "  call input 0\n"; 
     } else if (i.callType() == tuple_error) {
-      out << "  call tuple_error 3\n"; 
+      out << "  call tuple-error 3\n"; 
     } else if (i.callType() == tensor_error) {
       if (i.nArgs()->value() == 1) {
         out << "  call tensor-error 1\n"; 
@@ -124,25 +153,25 @@ namespace L2{
   void CodeGenBehavior::act(Instruction_reg_inc_dec &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.dst()->emit(options) << " " << string_from_inc_dec(i.op()) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.dst(), options) << " " << string_from_inc_dec(i.op()) << "\n"; 
   } 
 
   void CodeGenBehavior::act(Instruction_lea &i) {
     EmitOptions options; 
     options.l2tol1 = true; 
-    options.coloring = &colorInputs;
-    out << "  " << i.dst()->emit(options) << " @ " << i.lhs()->emit(options) << " " << i.rhs()->emit(options) << i.scale()->emit(options) << "\n"; 
+    options.coloring = colorInputs;
+    out << "  " << emitted(i.dst(), options) << " @ " << emitted(i.lhs(), options) << " " << emitted(i.rhs(), options) << " " << emitted(i.scale(), options) << "\n"; 
   } 
 
 
-  void generate_code(Program &p, const std::unordered_map<std::string, std::string> &colorInputs, size_t locals){
+  void generate_code(Program &p, const std::vector<functionAllocation> &allocations){
 
     std::ofstream outputFile;
-    outputFile.open("prog.S");
+    outputFile.open("prog.L1");
 
     // codegen
-    CodeGenBehavior b(outputFile, colorInputs, locals);
+    CodeGenBehavior b(outputFile, allocations);
     p.accept(b); 
 
     outputFile.close();
@@ -2,12 +2,13 @@
 
 #include <L2.h> 
 #include <behavior.h> 
+#include <liveness_analysis.h> 
 
 
 namespace L2 {
   class CodeGenBehavior : public Behavior {
     public:
-      explicit CodeGenBehavior(std::ofstream &out, const std::unordered_map<std::string, std::string> &colorInputs, size_t locals);
+      explicit CodeGenBehavior(std::ostream &stream, const std::vector<functionAllocation> &allocations);
       void act(Program &p) override; 
       void act(Function &f) override; 
       virtual void act(Instruction_assignment &i) override; 
@@ -25,10 +26,18 @@ namespace L2 {
       virtual void act(Instruction_lea &i) override; 
 
     private: 
-      std::unordered_map<std::string, std::string> colorInputs; 
+      // The register an item ends up in, -1 if it isn't a register or variable
+      long register_of(const Item* item) const; 
+
+      const std::vector<functionAllocation> &allocations; 
+      size_t cur_f = 0; 
+      const std::unordered_map<Symbol, RegisterID>* colorInputs = nullptr; 
       size_t locals; 
-      std::ofstream &out; 
+      // Code is buffered and written to the stream once this much is pending
+      static constexpr size_t flushSize = 1 << 20; 
+      Emitter out; 
+      std::ostream &stream; 
   };
 
-  void generate_code(Program &p, const std::unordered_map<std::string, std::string> &colorInputs, size_t locals);
+  void generate_code(Program &p, const std::vector<functionAllocation> &allocations);
 }
@@ -19,16 +19,11 @@
 #include <parser.h>
 #include <behavior.h>
 #include <liveness_analysis.h>
-
-std::string read_file(const char *path) {
-  std::ifstream in(path);
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  return buffer.str();
-}
+#include <code_generator.h>
+#include <trace.h>
 
 void print_help (char *progName){
-  std::cerr << "Usage: " << progName << " [-v] [-i] [-g 0|1] [-O 0|1|2] SOURCE" << std::endl;
+  std::cerr << "Usage: " << progName << " [-v] [-t CATEGORIES] [-l] [-i] [-g 0|1] [-O 0|1|2] [-j N] SOURCE" << std::endl;
   return ;
 }
 
@@ -40,7 +35,8 @@ int main(
   auto liveness_analysis = false; 
   bool interference = false; 
   int32_t optLevel = 0;
-  bool verbose;
+  size_t jobs = 1;
+  bool verbose = false;
 
   /* 
    * Check the compiler arguments.
@@ -50,7 +46,7 @@ int main(
     return 1;
   }
   int32_t opt;
-  while ((opt = getopt(argc, argv, "vlig:O:")) != -1) {
+  while ((opt = getopt(argc, argv, "vt:lig:O:j:")) != -1) {
     switch (opt){
       case 'O':
         optLevel = strtoul(optarg, NULL, 0);
@@ -62,6 +58,11 @@ int main(
 
       case 'v':
         verbose = true;
+        L2::traceMask |= L2::TraceAll;
+        break ;
+
+      case 't':
+        L2::traceMask |= L2::trace_categories(optarg);
         break ;
       
       case 'l':
@@ -72,6 +73,10 @@ int main(
         interference = true; 
         break; 
 
+      case 'j':
+        jobs = strtoul(optarg, NULL, 0);
+        break ;
+
       default:
         print_help(argv[0]);
         return 1;
@@ -82,21 +87,24 @@ int main(
   /*
    * Parse the input file.
    */
+  if (verbose) {
+    L2::check_grammar();
+  }
   
-  std::string src = read_file(argv[optind]);
-  src = "(@go\n" + src + ")";
-
-  const char *tmp = "/tmp/l2_tmp.L2";
-  std::ofstream out(tmp);
-  out << src;
-  out.close();
-  auto p = L2::parse_file((char*)tmp);
+  auto p = L2::parse_file(argv[optind]);
 
   /*
    * Perform liveness analysis 
    */
 
-  L2::analyze_liveness(p); 
+  auto allocations = L2::analyze_liveness(p, liveness_analysis, interference, jobs); 
+
+  /*
+   * Generate L1 code.
+   */
+  if (enable_code_generator) {
+    L2::generate_code(p, allocations); 
+  }
 
   return 0;
 }
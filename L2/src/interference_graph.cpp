@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <utility>
+
+#include <interference_graph.h>
+
+namespace L2 {
+
+  // Row a of the lower triangle holds a bits, one per b < a
+  size_t InterferenceGraph::bit_index(size_t a, size_t b) {
+    if (a < b) std::swap(a, b);
+    return a * (a - 1) / 2 + b;
+  }
+
+  void InterferenceGraph::reset(size_t n, size_t precolored) {
+    nodes = n;
+    size_t bits = n * (n - 1) / 2;
+    matrix.assign((bits + 63) / 64, 0);
+    adjacency.assign(n, {});
+
+    // The clique occupies the first rows of the triangle, so its bits are a prefix
+    size_t cliqueBits = precolored * (precolored - 1) / 2;
+    for (size_t i = 0; i < cliqueBits; i++) {
+      matrix[i / 64] |= uint64_t{1} << (i % 64);
+    }
+    for (size_t a = 0; a < precolored; a++) {
+      for (size_t b = 0; b < precolored; b++) {
+        if (a != b) adjacency[a].push_back(static_cast<uint32_t>(b));
+      }
+    }
+  }
+
+  void InterferenceGraph::grow(size_t n) {
+    if (n <= nodes) return;
+    nodes = n;
+    size_t bits = n * (n - 1) / 2;
+    matrix.resize((bits + 63) / 64, 0);
+    adjacency.resize(n);
+  }
+
+  void InterferenceGraph::remove_node(size_t a) {
+    for (uint32_t b : adjacency[a]) {
+      size_t i = bit_index(a, b);
+      matrix[i / 64] &= ~(uint64_t{1} << (i % 64));
+      auto& other = adjacency[b];
+      auto it = std::find(other.begin(), other.end(), static_cast<uint32_t>(a));
+      *it = other.back();
+      other.pop_back();
+    }
+    adjacency[a].clear();
+  }
+
+  bool InterferenceGraph::interferes(size_t a, size_t b) const {
+    if (a == b) return false;
+    size_t i = bit_index(a, b);
+    return (matrix[i / 64] >> (i % 64)) & 1;
+  }
+
+  bool InterferenceGraph::add_edge(size_t a, size_t b) {
+    if (a == b) return false;
+    size_t i = bit_index(a, b);
+    uint64_t mask = uint64_t{1} << (i % 64);
+    if (matrix[i / 64] & mask) return false;
+    matrix[i / 64] |= mask;
+    adjacency[a].push_back(static_cast<uint32_t>(b));
+    adjacency[b].push_back(static_cast<uint32_t>(a));
+    return true;
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace L2 {
+
+  /*
+   * Undirected graph over dense node IDs. A triangular bit matrix answers
+   * "do a and b interfere" in O(1), and per-node adjacency vectors give
+   * cheap iteration. Degrees are kept up to date as edges are added.
+   */
+  class InterferenceGraph {
+    public:
+      // Nodes below precolored are physical registers and start out as a clique
+      void reset(size_t n, size_t precolored = 0);
+      size_t size() const { return nodes; }
+
+      // Adds nodes up to n; existing edges keep their bits
+      void grow(size_t n);
+      // Drops every edge of a, leaving it isolated
+      void remove_node(size_t a);
+
+      bool interferes(size_t a, size_t b) const;
+
+      // Adds a-b unless a == b or the edge exists; returns true if it was new
+      bool add_edge(size_t a, size_t b);
+
+      const std::vector<uint32_t>& neighbors(size_t a) const { return adjacency[a]; }
+      size_t degree(size_t a) const { return adjacency[a].size(); }
+
+    private:
+      static size_t bit_index(size_t a, size_t b);
+
+      size_t nodes = 0;
+      std::vector<uint64_t> matrix;
+      std::vector<std::vector<uint32_t>> adjacency;
+  };
+}
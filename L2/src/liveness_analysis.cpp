@@ -1,38 +1,71 @@
+#include <cmath>
+#include <limits>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <exception>
+#include <stdexcept>
 
 #include <liveness_analysis.h>
 
 // output of spill should be tempCounter + number of spills (gets # of locals, if we spill everything, we already know though)
 namespace L2{
 
-    LivenessAnalysisBehavior::LivenessAnalysisBehavior(std::ostream &out)
-    : out (out) {
+    LivenessAnalysisBehavior::LivenessAnalysisBehavior(std::ostream &out, bool printLiveness, bool printInterference)
+    : printLiveness (printLiveness), printInterference (printInterference), out (out) {
       return; 
     }
 
     void LivenessAnalysisBehavior::act(Program& p) { 
         initialize_containers(p.functions.size()); 
-        for (int i = 0; i < p.functions.size(); i++) {
-            clear_function_containers();
-            p.functions[i]->accept(*this);
-            generate_in_out_sets(p);
-            generate_interference_graph(p);
-            while (true) {
-                clear_function_containers();
-                p.functions[i]->accept(*this);
-                generate_in_out_sets(p);
-                generate_interference_graph(p);
-                if (color_graph()) break; // so now we have spilloutputs and coloroutputs for each function 
-                std::tie(tempCounters[i], spillCounters[i]) = spill(p, spillOutputs[i], cur_f, tempCounters[i], spillCounters[i]); 
-            } 
-            cur_f=i; 
+        for (size_t i = 0; i < p.functions.size(); i++) {
+            allocate_function(p, i, p.arena); 
+            // the interference test prints the first function's graph afterwards
+            if (i != 0 || !printInterference) {
+                release_function(i); 
+            }
         }
 
-        //print_liveness_tests();
-        print_interference_tests();
-        
+        if (printInterference) {
+            print_interference_tests();
+        }
+    }
+
+    // Spill temporaries are allocated from arena, which has to outlive the program's IR
+    void LivenessAnalysisBehavior::allocate_function(Program& p, size_t i, Arena& arena) {
+        cur_f = i;
+        clear_function_containers();
+        p.functions[i]->accept(*this);
+        generate_in_out_sets(p);
+        if (printLiveness && i == 0) {
+            generate_instruction_in_out_sets();
+            print_liveness_tests();
+        }
+        generate_interference_graph(p);
+        L2_TRACE(TraceLiveness, "liveness " << p.functions[i]->name << ": " << p.functions[i]->instructions.size() << " instructions, " 
+            << cfgs[i].blocks.size() << " blocks, " << itemSymbols[i].size() << " items"); 
+        while (!color_graph()) {
+            L2_TRACE(TraceLiveness, "liveness " << p.functions[i]->name << ": " << spillOutputs[i].size() << " uncolorable"); 
+            // a spill temporary boxed in by registers and other temporaries; another round would change nothing
+            if (spillOutputs[i].empty()) {
+                throw std::runtime_error("cannot allocate registers for " + p.functions[i]->name + ": a spill temporary conflicts only with registers and other temporaries"); 
+            }
+            std::vector<Instruction*> before = p.functions[i]->instructions; 
+            auto constants = constant_variables(); 
+            auto crowded = crowded_instructions(before); 
+            Insertions insertions(before.size()); 
+            bool split = split_around_loops(p, arena, constants, insertions); 
+            auto promotions = promote_in_loops(p, arena, constants, insertions); 
+            if (split || !promotions.empty()) {
+                insert_instructions(*p.functions[i], insertions); 
+            }
+            if (!spillOutputs[i].empty()) {
+                std::tie(tempCounters[i], spillCounters[i]) = spill(p, arena, spillOutputs[i], constants, splitSlots[i], crowded, promotions, spillTemps[i], slotItems[i], itemIds[i], cur_f, tempCounters[i], spillCounters[i]); 
+            }
+            update_after_spill(p, before, split || !promotions.empty()); 
+        }
+        spillCounters[i] = color_stack_slots(*p.functions[i], cfgs[i], arena, spillCounters[i], slotItems[i]); 
     }
 
     void LivenessAnalysisBehavior::act(Function& f) {
@@ -49,20 +82,19 @@ namespace L2{
         Item* dst = i.dst(); 
         Item* src = i.src(); 
 
-        collectVar(src);
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(src)) {
-            ls.gen.insert(src->emit(options));
+            ls.gen.set(itemId(src));
         }
         if (isLivenessContributor(dst)) {
             if (dst->kind() == ItemType::MemoryItem) {
-                ls.gen.insert(dst->emit(options)); 
+                ls.gen.set(itemId(dst)); 
             } else {
-                ls.kill.insert(dst->emit(options));
+                ls.kill.set(itemId(dst));
+                if (isLivenessContributor(src) && src->kind() != ItemType::MemoryItem) {
+                    ls.copySource = itemId(src); 
+                } else if (src->kind() == ItemType::NumberItem || src->kind() == ItemType::LabelItem || src->kind() == ItemType::FuncItem) {
+                    ls.constantSource = src; 
+                }
             } 
         }
     }
@@ -70,14 +102,9 @@ namespace L2{
     void LivenessAnalysisBehavior::act(Instruction_stack_arg_assignment& i) {
         auto &ls = livenessData[cur_f][cur_i]; 
         Item* dst = i.dst(); 
-   
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
 
         if (isLivenessContributor(dst)) {
-            ls.kill.insert(dst->emit(options));
+            ls.kill.set(itemId(dst));
         }
     }
 
@@ -86,18 +113,12 @@ namespace L2{
         Item* dst = i.dst(); 
         Item* src = i.rhs(); 
 
-        collectVar(src);
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(src)) {
-            ls.gen.insert(src->emit(options));
+            ls.gen.set(itemId(src));
         }
         if (isLivenessContributor(dst)) {
-            ls.gen.insert(dst->emit(options)); 
-            ls.kill.insert(dst->emit(options)); 
+            ls.gen.set(itemId(dst)); 
+            ls.kill.set(itemId(dst)); 
         }
     }
 
@@ -106,18 +127,13 @@ namespace L2{
         Item* dst = i.dst(); 
         Item* src = i.src(); 
 
-        collectVar(src);
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(src)) {
-            ls.gen.insert(src->emit(options));
+            ls.gen.set(itemId(src));
+            shiftSources[cur_f].push_back(itemId(src)); 
         }
         if (isLivenessContributor(dst)) {
-            ls.gen.insert(dst->emit(options)); 
-            ls.kill.insert(dst->emit(options));
+            ls.gen.set(itemId(dst)); 
+            ls.kill.set(itemId(dst));
         } 
     }
     
@@ -126,20 +142,14 @@ namespace L2{
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
 
-        collectVar(lhs);
-        collectVar(rhs);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(lhs)) {
-            ls.gen.insert(lhs->emit(options));
+            ls.gen.set(itemId(lhs));
             if (lhs->kind() != ItemType::MemoryItem) {
-                ls.kill.insert(lhs->emit(options)); 
+                ls.kill.set(itemId(lhs)); 
             }
         }
         if (isLivenessContributor(rhs)) {
-            ls.gen.insert(rhs->emit(options));
+            ls.gen.set(itemId(rhs));
         }
     }
 
@@ -149,21 +159,14 @@ namespace L2{
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
 
-        collectVar(lhs);
-        collectVar(rhs);
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(dst)) {
-            ls.kill.insert(dst->emit(options));
+            ls.kill.set(itemId(dst));
         } 
         if (isLivenessContributor(lhs)) {
-            ls.gen.insert(lhs->emit(options)); 
+            ls.gen.set(itemId(lhs)); 
         }
         if (isLivenessContributor(rhs)) {
-            ls.gen.insert(rhs->emit(options));
+            ls.gen.set(itemId(rhs));
         }
     }
 
@@ -172,26 +175,16 @@ namespace L2{
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
 
-        collectVar(lhs);
-        collectVar(rhs);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(lhs)) {
-            ls.gen.insert(lhs->emit(options)); 
+            ls.gen.set(itemId(lhs)); 
         }
         if (isLivenessContributor(rhs)) {
-            ls.gen.insert(rhs->emit(options));
+            ls.gen.set(itemId(rhs));
         }
     }
 
     void LivenessAnalysisBehavior::act(Instruction_label& i) {
         // empty gen + kill
-
-        // Store instruction # -> label
-        auto &lm = labelMap[cur_f]; 
-        lm[i.label()->emit()] = cur_i;
     }
 
     void LivenessAnalysisBehavior::act(Instruction_goto& i) {
@@ -200,34 +193,33 @@ namespace L2{
 
     void LivenessAnalysisBehavior::act(Instruction_ret& i) {
         auto &ls = livenessData[cur_f][cur_i];
-        std::unordered_set<std::string> callee_save_registers = {"r12", "r13", "r14", "r15", "rbp", "rbx"}; 
-        ls.gen.insert("rax"); 
-        ls.gen.insert(callee_save_registers.begin(), callee_save_registers.end()); 
+        std::vector<RegisterID> callee_save_registers = {r12, r13, r14, r15, rbp, rbx}; 
+        ls.gen.set(RegisterID::rax); 
+        for (RegisterID r : callee_save_registers) {
+            ls.gen.set(r); 
+        }
     }
 
     void LivenessAnalysisBehavior::act(Instruction_call& i) {
         auto &ls = livenessData[cur_f][cur_i];
-        std::unordered_set<std::string> caller_save_registers = {"r10", "r11", "r8", "r9", "rax", "rcx", "rdi", "rdx", "rsi"}; 
-        ls.kill.insert(caller_save_registers.begin(), caller_save_registers.end());
+        std::vector<RegisterID> caller_save_registers = {r10, r11, r8, r9, rax, rcx, rdi, rdx, rsi}; 
+        for (RegisterID r : caller_save_registers) {
+            ls.kill.set(r); 
+        }
 
-        std::vector<std::string> argument_registers = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+        std::vector<RegisterID> argument_registers = {rdi, rsi, rdx, rcx, r8, r9};
 
         if (i.callType() == CallType::l1) {
             Item* callee = i.callee();
 
-            collectVar(callee); 
-
             if (isLivenessContributor(callee)) {
-                EmitOptions options; 
-                options.livenessAnalysis = true; 
-
-                ls.gen.insert(callee->emit(options));
+                ls.gen.set(itemId(callee));
             }
         }
 
         int64_t num_args = i.nArgs()->value(); 
         for (int argIndex = 0; argIndex < std::min(num_args, static_cast<int64_t>(6)); argIndex++) {
-            ls.gen.insert(argument_registers[argIndex]);
+            ls.gen.set(argument_registers[argIndex]);
         }
     }
 
@@ -235,14 +227,9 @@ namespace L2{
         auto &ls = livenessData[cur_f][cur_i];
         Item* dst = i.dst(); 
 
-        collectVar(dst); 
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(dst)) {
-            ls.gen.insert(dst->emit(options)); 
-            ls.kill.insert(dst->emit(options));
+            ls.gen.set(itemId(dst)); 
+            ls.kill.set(itemId(dst));
         } 
     }
 
@@ -252,276 +239,1006 @@ namespace L2{
         Item* lhs = i.lhs();
         Item* rhs = i.rhs();
 
-        collectVar(lhs);
-        collectVar(rhs); 
-        collectVar(dst);
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-
         if (isLivenessContributor(lhs)) {
-            ls.gen.insert(lhs->emit(options));
+            ls.gen.set(itemId(lhs));
         }
         if (isLivenessContributor(rhs)) {
-            ls.gen.insert(rhs->emit(options));
+            ls.gen.set(itemId(rhs));
         }
         if (isLivenessContributor(dst)) {
-            ls.kill.insert(dst->emit(options));
+            ls.kill.set(itemId(dst));
         }         
     }
 
     void LivenessAnalysisBehavior::initialize_containers(size_t n) {
         tempCounters.resize(n, 0); 
+        spillCounters.resize(n, 0); 
 
-        variables.resize(n); 
+        itemSymbols.resize(n); 
+        itemIds.resize(n); 
         livenessData.resize(n); 
-        labelMap.resize(n); 
+        shiftSources.resize(n); 
+        cfgs.resize(n); 
+        blockLiveness.resize(n); 
         interferenceGraph.resize(n);
+        coalescedGraph.resize(n); 
+        coalescedInto.resize(n); 
+        spillCosts.resize(n); 
         nodeDegrees.resize(n); 
+        degreeQueue.resize(n); 
+        spillQueue.resize(n); 
+        nodeColors.resize(n); 
+        retiredNodes.resize(n); 
         removed_nodes.resize(n); 
         node_stack.resize(n); 
         spillOutputs.resize(n); 
+        spillTemps.resize(n); 
+        splitSlots.resize(n); 
+        slotItems.resize(n); 
+        loopVariables.resize(n); 
         colorOutputs.resize(n);
     }
 
     void LivenessAnalysisBehavior::clear_function_containers() {
-        variables[cur_f].clear(); 
+        // registers take IDs 0..rsp, so itemSymbols only means something past them
+        itemSymbols[cur_f].assign(RegisterID::rsp + 1, 0); 
+        itemIds[cur_f].clear(); 
         livenessData[cur_f].clear();
-        labelMap[cur_f].clear(); 
-        interferenceGraph[cur_f].clear(); 
+        shiftSources[cur_f].clear(); 
+        interferenceGraph[cur_f].reset(0); 
+        coalescedGraph[cur_f].reset(0); 
+        coalescedInto[cur_f].clear(); 
+        spillCosts[cur_f].clear(); 
         nodeDegrees[cur_f].clear(); 
+        degreeQueue[cur_f].clear(); 
+        spillQueue[cur_f].clear(); 
+        nodeColors[cur_f].clear(); 
+        retiredNodes[cur_f].clear(); 
         removed_nodes[cur_f].clear(); 
         node_stack[cur_f].clear(); 
         spillOutputs[cur_f].clear(); 
         colorOutputs[cur_f].clear(); 
     }
 
+    // Moving a fresh container in frees the old one's storage, which clear() would keep
+    template <typename T>
+    static void release(T &container) {
+        container = T(); 
+    }
+
+    void LivenessAnalysisBehavior::release_function(size_t f) {
+        release(itemSymbols[f]); 
+        release(itemIds[f]); 
+        release(livenessData[f]); 
+        release(shiftSources[f]); 
+        release(cfgs[f]); 
+        release(blockLiveness[f]); 
+        release(interferenceGraph[f]); 
+        release(coalescedGraph[f]); 
+        release(coalescedInto[f]); 
+        release(spillCosts[f]); 
+        release(nodeDegrees[f]); 
+        release(degreeQueue[f]); 
+        release(spillQueue[f]); 
+        release(nodeColors[f]); 
+        release(retiredNodes[f]); 
+        release(removed_nodes[f]); 
+        release(node_stack[f]); 
+        release(spillOutputs[f]); 
+        release(spillTemps[f]); 
+        release(splitSlots[f]); 
+        release(slotItems[f]); 
+        release(loopVariables[f]); 
+    }
+
     bool LivenessAnalysisBehavior::isVariable(const Item* var) {
         return var->kind() == ItemType::VariableItem; 
     }
 
     bool LivenessAnalysisBehavior::isLivenessContributor(const Item* var) {
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
-        return (var->kind() == ItemType::RegisterItem && var->emit() != "%rsp") || var->kind() == ItemType::VariableItem || (var->kind() == ItemType::MemoryItem && var->emit(options) != "rsp");
-    }
-
-    bool LivenessAnalysisBehavior::isNoSuccessorInstruction(const Instruction* i) {
-        if (auto *inst = dynamic_cast<const Instruction_call*>(i)) {
-            if (inst->callType() == CallType::tuple_error || inst->callType() == CallType::tensor_error) {
-                return true;
-            }
+        switch (var->kind()) {
+            case ItemType::RegisterItem: return static_cast<const Register*>(var)->id() != RegisterID::rsp; 
+            case ItemType::VariableItem: return true; 
+            case ItemType::MemoryItem: return isLivenessContributor(static_cast<const Memory*>(var)->getVar()); 
+            default: return false; 
         }
-        return dynamic_cast<const Instruction_ret*>(i);
     }
 
 
+
     void LivenessAnalysisBehavior::print_instruction_gen_kill(size_t cur_i, const livenessSets& ls) {
         std::cout << cur_i << " gen set: ";
         bool first = true;
-        for (const auto &s : ls.gen) {
+        ls.gen.for_each([&](size_t id) {
             if (!first) std::cout << ", ";
-            std::cout << s;
+            std::cout << item_name(cur_f, id);
             first = false;
-        }
+        });
         std::cout << "\n";
 
         std::cout << cur_i << " kill set: ";
         first = true;
-        for (const auto &s : ls.kill) {
+        ls.kill.for_each([&](size_t id) {
             if (!first) std::cout << ", ";
-            std::cout << s;
+            std::cout << item_name(cur_f, id);
             first = false;
-        }
+        });
         std::cout << "\n\n";  
     }
 
-    void LivenessAnalysisBehavior::collectVar(const Item* i) {
-        if (!i) return; 
-        if (!isLivenessContributor(i)) return; 
-
-        EmitOptions options; 
-        options.livenessAnalysis = true; 
+    size_t LivenessAnalysisBehavior::itemId(const Item* i) {
+        if (i->kind() == ItemType::RegisterItem) {
+            return static_cast<const Register*>(i)->id(); 
+        }
+        if (i->kind() == ItemType::MemoryItem) {
+            return itemId(static_cast<const Memory*>(i)->getVar()); 
+        }
+        Symbol s = static_cast<const Variable*>(i)->symbol(); 
+        auto& ids = itemIds[cur_f]; 
+        auto it = ids.find(s); 
+        if (it != ids.end()) {
+            return it->second; 
+        }
+        size_t id = itemSymbols[cur_f].size(); 
+        itemSymbols[cur_f].push_back(s); 
+        ids.emplace(s, id); 
+        return id; 
+    }
 
-        std::string s = i->emit(options);
-        if (!s.empty() && s[0] == '%') {
-            variables[cur_f].insert(s);
+    std::string LivenessAnalysisBehavior::item_name(size_t f, size_t id) {
+        if (id <= RegisterID::rsp) {
+            return std::string(string_from_register(static_cast<RegisterID>(id))); 
         }
+        return symbol_name(itemSymbols[f][id]); 
     }
 
     void LivenessAnalysisBehavior::generate_in_out_sets(const Program &p) {
-        bool change = true; 
-        auto& functionInstructions = p.functions[cur_f]->instructions; 
+        cfgs[cur_f] = build_cfg(*p.functions[cur_f]); 
+        const auto& functionBlocks = cfgs[cur_f].blocks; 
+        size_t n = itemSymbols[cur_f].size(); 
+        for (auto& ls : livenessData[cur_f]) {
+            ls.gen.resize(n); 
+            ls.kill.resize(n); 
+            ls.in.resize(n); 
+            ls.out.resize(n); 
+        }
+
+        blockLiveness[cur_f].assign(functionBlocks.size(), livenessSets{BitVector(n), BitVector(n), BitVector(n), BitVector(n)}); 
+        for (size_t b = 0; b < functionBlocks.size(); b++) {
+            summarize_block(b); 
+        }
+
+        // Seed the worklist in post-order of the CFG, which is the reverse post-order for
+        // this backward problem: a block is usually visited after all of its successors.
+        solve_liveness(cfgs[cur_f].post_order()); 
+    }
+
+    // Block gen is its upward-exposed uses, block kill everything it defines
+    void LivenessAnalysisBehavior::summarize_block(size_t b) {
+        const BasicBlock& bb = cfgs[cur_f].blocks[b]; 
         auto& functionLivenessData = livenessData[cur_f]; 
-        auto& functionLabelMap = labelMap[cur_f]; 
-        while (change) {
-            change = false; 
-            for (int j = (int)functionLivenessData.size()-1; j>=0; j--) {
-                livenessSets& ls = functionLivenessData[j];
-                std::unordered_set<std::string> original_in = ls.in; 
-                std::unordered_set<std::string> original_out = ls.out; 
-                Instruction* cur_instruction = functionInstructions[j];
-                if (isNoSuccessorInstruction(cur_instruction)) {
-                    // no successors, out is empty 
-                } else if (auto *gt = dynamic_cast<const Instruction_goto*>(cur_instruction)) {
-                    const std::string label = gt->label()->emit();
-                    size_t label_instruction_index = functionLabelMap[label]; 
-                    livenessSets& ls_label_instruction = functionLivenessData[label_instruction_index]; 
-                    ls.out = ls_label_instruction.in;
-                } else if (auto *cj = dynamic_cast<const Instruction_cjump*>(cur_instruction)) {
-                    const std::string label = cj->label()->emit();
-                    size_t label_instruction_index = functionLabelMap[label]; 
-                    livenessSets& ls_label_instruction = functionLivenessData[label_instruction_index]; 
-                    ls.out = ls_label_instruction.in;
-
-                    livenessSets& ls_next_inst = functionLivenessData[j+1];
-                    ls.out.insert(ls_next_inst.in.begin(), ls_next_inst.in.end()); 
-                } else {
-                    livenessSets& ls_next_inst = functionLivenessData[j+1]; 
-                    ls.out = ls_next_inst.in; 
-                }
-                std::unordered_set out_kill_diff_set = set_difference(ls.out, ls.kill);
-                ls.in = set_union(ls.gen, out_kill_diff_set);
-                if (ls.in != original_in || ls.out != original_out) {
-                    change = true;
+        livenessSets& bs = blockLiveness[cur_f][b]; 
+        bs.gen.clear(); 
+        bs.kill.clear(); 
+        BitVector scratch(bs.gen.size()); 
+        for (size_t j = bb.last + 1; j-- > bb.first; ) {
+            const livenessSets& ls = functionLivenessData[j]; 
+            scratch.assign_gen_out_kill(ls.gen, bs.gen, ls.kill); 
+            std::swap(scratch, bs.gen); 
+            bs.kill.union_with(ls.kill); 
+        }
+    }
+
+    // Returns every block the worklist visited
+    std::vector<size_t> LivenessAnalysisBehavior::solve_liveness(const std::vector<size_t> &seeds) {
+        const auto& functionBlocks = cfgs[cur_f].blocks; 
+        auto& functionBlockLiveness = blockLiveness[cur_f]; 
+        std::deque<size_t> worklist(seeds.begin(), seeds.end()); 
+        std::vector<bool> queued(functionBlocks.size(), false); 
+        for (size_t b : seeds) {
+            queued[b] = true; 
+        }
+        std::vector<size_t> visited; 
+        std::vector<bool> seen(functionBlocks.size(), false); 
+        while (!worklist.empty()) {
+            size_t b = worklist.front(); 
+            worklist.pop_front(); 
+            queued[b] = false; 
+            if (!seen[b]) {
+                seen[b] = true; 
+                visited.push_back(b); 
+            }
+            livenessSets& bs = functionBlockLiveness[b]; 
+            bs.out.clear(); 
+            for (size_t s : functionBlocks[b].succs) {
+                bs.out.union_with(functionBlockLiveness[s].in); 
+            }
+            if (bs.in.assign_gen_out_kill(bs.gen, bs.out, bs.kill)) {
+                for (size_t pred : functionBlocks[b].preds) {
+                    if (!queued[pred]) {
+                        queued[pred] = true; 
+                        worklist.push_back(pred); 
+                    }
                 }
             }
         }
+        return visited; 
     }
 
+    void LivenessAnalysisBehavior::generate_instruction_in_out_sets() {
+        for (size_t b = 0; b < cfgs[cur_f].blocks.size(); b++) {
+            generate_block_in_out_sets(b); 
+        }
+    }
 
+    void LivenessAnalysisBehavior::generate_block_in_out_sets(size_t b) {
+        auto& functionLivenessData = livenessData[cur_f]; 
+        const BasicBlock& bb = cfgs[cur_f].blocks[b]; 
+        for (size_t j = bb.last + 1; j-- > bb.first; ) {
+            livenessSets& ls = functionLivenessData[j]; 
+            ls.out = j == bb.last ? blockLiveness[cur_f][b].out : functionLivenessData[j+1].in; 
+            ls.in.assign_gen_out_kill(ls.gen, ls.out, ls.kill); 
+        }
+    }
 
 
-    void LivenessAnalysisBehavior::generate_interference_graph(const Program &p) {
-        auto& functionInterferenceGraph = interferenceGraph[cur_f];  
+
+
+    void LivenessAnalysisBehavior::add_edges(const BitVector& A, const BitVector& B) {
+        auto& functionInterferenceGraph = interferenceGraph[cur_f]; 
+        A.for_each([&](size_t a) {
+            B.for_each([&](size_t b) {
+                functionInterferenceGraph.add_edge(a, b); 
+            }); 
+        }); 
+    }
+
+    // A value interferes with everything live where another value is defined.
+    // Values live into a block nothing enters were never defined on the way in,
+    // so they get their edges there instead.
+    void LivenessAnalysisBehavior::add_block_edges(size_t b) {
+        const CFG& cfg = cfgs[cur_f]; 
+        const auto& bb = cfg.blocks[b]; 
         auto& functionLivenessData = livenessData[cur_f]; 
-        auto& functionInstructions = p.functions[cur_f]->instructions; 
-        for (int j = 0; j<(int)functionLivenessData.size(); j++) {
+        if (b == 0 || bb.preds.empty() || !cfg.reachable[b]) {
+            const BitVector& in = functionLivenessData[bb.first].in; 
+            add_edges(in, in); 
+        }
+        for (size_t j = bb.first; j <= bb.last; j++) {
             livenessSets& ls = functionLivenessData[j];
-            Instruction* cur_instruction = functionInstructions[j]; 
-            for (const auto& v: variables[cur_f]) {
-                functionInterferenceGraph[v];
-            }
-            add_edges_to_graph(functionInterferenceGraph, ls.in, ls.in);
-            add_edges_to_graph(functionInterferenceGraph, ls.out, ls.out);
-            add_edges_to_graph(functionInterferenceGraph, ls.kill, ls.out); 
-            add_edges_to_graph(functionInterferenceGraph, GPregisters, GPregisters);
-            if (auto *shift = dynamic_cast<const Instruction_sop*>(cur_instruction)) {
-                if (auto* n = dynamic_cast<const Number*>(shift->src())) {
-                    continue;
+            add_edges(ls.kill, ls.out); 
+        }
+    }
+
+    // shift amounts can only live in rcx
+    void LivenessAnalysisBehavior::add_shift_edges() {
+        for (size_t id : shiftSources[cur_f]) {
+            if (retiredNodes[cur_f][id]) { continue; } 
+            for (RegisterID r : GPregisters_without_rcx) {
+                interferenceGraph[cur_f].add_edge(id, r); 
+            }
+        }
+    }
+
+    void LivenessAnalysisBehavior::compute_degrees() {
+        size_t n = interferenceGraph[cur_f].size(); 
+        nodeDegrees[cur_f].assign(n, 0); 
+        for (size_t id = 0; id < n; id++) {
+            nodeDegrees[cur_f][id] = interferenceGraph[cur_f].degree(id); 
+        }
+    }
+
+    void LivenessAnalysisBehavior::generate_interference_graph(const Program &p) {
+        generate_instruction_in_out_sets(); 
+        size_t n = itemSymbols[cur_f].size(); 
+        // rdi..r15 are precolored nodes that all interfere; rsp is never allocated
+        interferenceGraph[cur_f].reset(n, GPregisters.size()); 
+        retiredNodes[cur_f].assign(n, false); 
+        for (size_t b = 0; b < cfgs[cur_f].blocks.size(); b++) {
+            add_block_edges(b); 
+        }
+        add_shift_edges(); 
+        compute_degrees(); 
+    }
+
+    // Loops with their nests ahead of the loops inside them
+    std::vector<size_t> LivenessAnalysisBehavior::loops_outermost_first() {
+        const CFG& cfg = cfgs[cur_f]; 
+        std::vector<size_t> loops(cfg.loops.size()); 
+        for (size_t l = 0; l < loops.size(); l++) {
+            loops[l] = l; 
+        }
+        std::stable_sort(loops.begin(), loops.end(), [&](size_t a, size_t b) {
+            return cfg.loops[a].blocks.size() > cfg.loops[b].blocks.size(); 
+        }); 
+        return loops; 
+    }
+
+    // Most items live at once anywhere in each loop, registers included and the excluded items left out
+    std::vector<size_t> LivenessAnalysisBehavior::loop_pressure(const std::vector<size_t> &excluded) {
+        const CFG& cfg = cfgs[cur_f]; 
+        const auto& functionLivenessData = livenessData[cur_f]; 
+        std::vector<size_t> pressure(cfg.loops.size(), 0); 
+        for (size_t l = 0; l < pressure.size(); l++) {
+            for (size_t b : cfg.loops[l].blocks) {
+                for (size_t j = cfg.blocks[b].first; j <= cfg.blocks[b].last; j++) {
+                    const BitVector& in = functionLivenessData[j].in; 
+                    size_t live = in.count(); 
+                    for (size_t id : excluded) {
+                        live -= in.test(id); 
+                    }
+                    pressure[l] = std::max(pressure[l], live); 
+                }
+            }
+        }
+        return pressure; 
+    }
+
+    // How often a block runs, guessed from its loop depth
+    double LivenessAnalysisBehavior::block_frequency(size_t b) {
+        return std::pow(10.0, std::min<size_t>(cfgs[cur_f].loopDepth[b], 8)); 
+    }
+
+    // Code that has to run whenever control enters the block from outside a loop goes at the end of a predecessor, ahead of its jump
+    void LivenessAnalysisBehavior::insert_at_end(size_t pred, Instruction* i, Insertions &insertions) {
+        const CFG& cfg = cfgs[cur_f]; 
+        size_t last = cfg.blocks[pred].last; 
+        bool jumps = cfg.flow[last] == Jump || cfg.flow[last] == Branch; 
+        (jumps ? insertions.before : insertions.after)[last].push_back(i); 
+    }
+
+    // Code for a loop exit goes at the start of the exit, ahead of anything for the loop that comes next
+    void LivenessAnalysisBehavior::insert_at_start(size_t exit, Instruction* i, Insertions &insertions) {
+        const CFG& cfg = cfgs[cur_f]; 
+        size_t first = cfg.blocks[exit].first; 
+        auto& at = (cfg.isLabel[first] ? insertions.after : insertions.before)[first]; 
+        at.insert(at.begin(), i); 
+    }
+
+    void LivenessAnalysisBehavior::insert_instructions(Function &f, const Insertions &insertions) {
+        std::vector<Instruction*> instructions; 
+        for (size_t j = 0; j < f.instructions.size(); j++) {
+            instructions.insert(instructions.end(), insertions.before[j].begin(), insertions.before[j].end()); 
+            instructions.push_back(f.instructions[j]); 
+            instructions.insert(instructions.end(), insertions.after[j].begin(), insertions.after[j].end()); 
+        }
+        f.instructions = std::move(instructions); 
+    }
+
+    /*
+     * Live-range splitting: an uncolorable variable that is live through a loop
+     * which never mentions it is stored on every edge into the loop and reloaded
+     * where it leaves, so it keeps a register outside the loop and frees one
+     * inside. That only pays off for loops with more values live than there are
+     * registers, when the stores and reloads cost less than spilling, and once
+     * per variable; a split variable that gets spilled later reuses the slot,
+     * which makes the split's stores and reloads redundant. Loops are tried
+     * outermost first. An exit that other blocks reach too would need a block
+     * of its own, so such loops are left alone; whatever can't be split is
+     * spilled as before.
+     */
+    bool LivenessAnalysisBehavior::split_around_loops(const Program &p, Arena &arena, const std::unordered_map<Symbol, Item*> &constants, Insertions &insertions) {
+        const CFG& cfg = cfgs[cur_f]; 
+        const auto& blocks = cfg.blocks; 
+        const auto& functionBlockLiveness = blockLiveness[cur_f]; 
+        auto loops = loops_outermost_first(); 
+        auto pressure = loop_pressure({}); 
+
+        std::vector<size_t> candidates; 
+        for (Symbol v : spillOutputs[cur_f]) {
+            // rematerializing a constant is cheaper still
+            if (!splitSlots[cur_f].count(v) && !constants.count(v)) {
+                candidates.push_back(itemIds[cur_f].at(v)); 
+            }
+        }
+        std::sort(candidates.begin(), candidates.end()); 
+
+        std::unordered_map<Symbol, int64_t> split; 
+        std::vector<bool> inLoop(blocks.size()); 
+        for (size_t id : candidates) {
+            Item* var = nullptr; 
+            Item* slot = nullptr; 
+            std::vector<bool> covered(blocks.size(), false); 
+            for (size_t l : loops) {
+                const Loop& loop = cfg.loops[l]; 
+                size_t h = loop.header; 
+                if (covered[h] || pressure[l] < GPregisters.size() || !functionBlockLiveness[h].in.test(id)) { continue; } 
+                if (std::find(cfg.roots.begin(), cfg.roots.end(), h) != cfg.roots.end()) { continue; } 
+
+                std::fill(inLoop.begin(), inLoop.end(), false); 
+                bool mentioned = false; 
+                for (size_t b : loop.blocks) {
+                    inLoop[b] = true; 
+                    mentioned |= functionBlockLiveness[b].gen.test(id) || functionBlockLiveness[b].kill.test(id); 
+                }
+                std::vector<size_t> exits; 
+                bool dedicated = true; 
+                for (size_t b : loop.blocks) {
+                    for (size_t e : blocks[b].succs) {
+                        if (inLoop[e] || !functionBlockLiveness[e].in.test(id)) { continue; } 
+                        for (size_t pred : blocks[e].preds) {
+                            dedicated &= inLoop[pred]; 
+                        }
+                        if (std::find(exits.begin(), exits.end(), e) == exits.end()) {
+                            exits.push_back(e); 
+                        }
+                    }
+                }
+                if (mentioned || !dedicated) { continue; } 
+                double cost = 0; 
+                for (size_t pred : blocks[h].preds) {
+                    cost += inLoop[pred] ? 0 : block_frequency(pred); 
+                }
+                for (size_t e : exits) {
+                    cost += block_frequency(e); 
+                }
+                if (cost >= spillCosts[cur_f][id]) { continue; } 
+
+                if (slot == nullptr) {
+                    int64_t offset = spillCounters[cur_f] * 8; 
+                    spillCounters[cur_f]++; 
+                    var = arena.make<Variable>(itemSymbols[cur_f][id]); 
+                    slot = arena.make<Memory>(canonical_register(RegisterID::rsp), make_number(arena, offset)); 
+                    slotItems[cur_f].insert(slot); 
+                    split.emplace(itemSymbols[cur_f][id], offset); 
+                }
+                for (size_t pred : blocks[h].preds) {
+                    if (!inLoop[pred]) {
+                        insert_at_end(pred, arena.make<Instruction_assignment>(slot, var), insertions); 
+                    }
+                }
+                for (size_t e : exits) {
+                    insert_at_start(e, arena.make<Instruction_assignment>(var, slot), insertions); 
+                }
+                for (size_t b : loop.blocks) {
+                    covered[b] = true; 
                 }
-                EmitOptions options; 
-                options.livenessAnalysis = true; 
-                std::unordered_set<std::string> rcxVar = {shift->src()->emit(options)};
-                add_edges_to_graph(functionInterferenceGraph, rcxVar, GPregisters_without_rcx); 
             }
         }
-        for (const auto& [key, val] : functionInterferenceGraph) {
-            nodeDegrees[cur_f][key] = val.size(); 
+        if (split.empty()) {
+            return false; 
+        }
+
+        for (auto [v, offset] : split) {
+            spillOutputs[cur_f].erase(v); 
+            splitSlots[cur_f].emplace(v, offset); 
         }
+        L2_TRACE(TraceSpill, "split " << p.functions[cur_f]->name << ": " << split.size() << " variables around loops"); 
+        return true; 
+    }
+
+    /*
+     * A spilled variable gets a register of its own inside a loop that has one to
+     * spare: copies on the edges into the loop load it, copies at the exits store
+     * it back if the loop defines it, and spill() renames its mentions in the loop
+     * instead of surrounding them with spill code. That pays off when the copies
+     * cost less than the spill code they replace; exits with a store must only be
+     * reachable from the loop. Loops are tried outermost first, each taking the
+     * variables that save the most while it has registers left once the spilled
+     * variables are gone. The new variables can spill like any other but are not
+     * promoted again.
+     */
+    LoopPromotions LivenessAnalysisBehavior::promote_in_loops(const Program &p, Arena &arena, const std::unordered_map<Symbol, Item*> &constants, Insertions &insertions) {
+        const Function& f = *p.functions[cur_f]; 
+        const CFG& cfg = cfgs[cur_f]; 
+        const auto& blocks = cfg.blocks; 
+        const auto& functionBlockLiveness = blockLiveness[cur_f]; 
+        const auto& functionLivenessData = livenessData[cur_f]; 
+
+        std::vector<size_t> spilled; 
+        std::vector<size_t> candidates; 
+        for (Symbol v : spillOutputs[cur_f]) {
+            spilled.push_back(itemIds[cur_f].at(v)); 
+            if (!constants.count(v) && !loopVariables[cur_f].count(v)) {
+                candidates.push_back(itemIds[cur_f].at(v)); 
+            }
+        }
+        std::sort(candidates.begin(), candidates.end()); 
+        auto pressure = loop_pressure(spilled); 
+
+        struct Promotion {
+            size_t candidate; 
+            double gain; 
+            bool liveIn; 
+            std::vector<size_t> exits; 
+        }; 
+        LoopPromotions promotions; 
+        size_t promoted = 0; 
+        std::vector<Item*> vars(candidates.size(), nullptr); 
+        std::vector<std::vector<bool>> covered(candidates.size(), std::vector<bool>(blocks.size(), false)); 
+        std::vector<bool> inLoop(blocks.size()); 
+        for (size_t l : loops_outermost_first()) {
+            const Loop& loop = cfg.loops[l]; 
+            size_t h = loop.header; 
+            if (pressure[l] + 1 >= GPregisters.size()) { continue; } 
+            if (std::find(cfg.roots.begin(), cfg.roots.end(), h) != cfg.roots.end()) { continue; } 
+            std::fill(inLoop.begin(), inLoop.end(), false); 
+            for (size_t b : loop.blocks) {
+                inLoop[b] = true; 
+            }
+
+            std::vector<Promotion> options; 
+            for (size_t c = 0; c < candidates.size(); c++) {
+                size_t id = candidates[c]; 
+                if (covered[c][h]) { continue; } 
+                double saved = 0; 
+                bool defined = false; 
+                for (size_t b : loop.blocks) {
+                    for (size_t j = blocks[b].first; j <= blocks[b].last; j++) {
+                        saved += (functionLivenessData[j].gen.test(id) + functionLivenessData[j].kill.test(id)) * block_frequency(b); 
+                    }
+                    defined |= functionBlockLiveness[b].kill.test(id); 
+                }
+                if (saved == 0) { continue; } 
+
+                bool liveIn = functionBlockLiveness[h].in.test(id); 
+                double cost = 0; 
+                for (size_t pred : blocks[h].preds) {
+                    cost += inLoop[pred] || !liveIn ? 0 : block_frequency(pred); 
+                }
+                // the slot is still current where the loop doesn't define the variable
+                std::vector<size_t> exits; 
+                bool dedicated = true; 
+                for (size_t b : loop.blocks) {
+                    for (size_t e : blocks[b].succs) {
+                        if (!defined || inLoop[e] || !functionBlockLiveness[e].in.test(id)) { continue; } 
+                        for (size_t pred : blocks[e].preds) {
+                            dedicated &= inLoop[pred]; 
+                        }
+                        if (std::find(exits.begin(), exits.end(), e) == exits.end()) {
+                            exits.push_back(e); 
+                            cost += block_frequency(e); 
+                        }
+                    }
+                }
+                if (dedicated && cost < saved) {
+                    options.push_back({c, saved - cost, liveIn, std::move(exits)}); 
+                }
+            }
+            std::stable_sort(options.begin(), options.end(), [](const Promotion& a, const Promotion& b) { return a.gain > b.gain; }); 
+
+            for (const Promotion& option : options) {
+                if (pressure[l] + 1 >= GPregisters.size()) { break; } 
+                size_t c = option.candidate; 
+                size_t id = candidates[c]; 
+                Symbol v = itemSymbols[cur_f][id]; 
+                Symbol s; 
+                do {
+                    std::ostringstream name; 
+                    name << "%L" << tempCounters[cur_f]; 
+                    tempCounters[cur_f]++; 
+                    s = intern(name.str()); 
+                } while (itemIds[cur_f].count(s)); 
+                loopVariables[cur_f].insert(s); 
+                loopVariables[cur_f].insert(v); 
+                Item* local = arena.make<Variable>(s); 
+                if (vars[c] == nullptr) {
+                    vars[c] = arena.make<Variable>(v); 
+                    if (!splitSlots[cur_f].count(v)) {
+                        splitSlots[cur_f].emplace(v, spillCounters[cur_f] * 8); 
+                        spillCounters[cur_f]++; 
+                    }
+                }
+                // should the loop variable spill too, it shares the slot and the copies go away
+                splitSlots[cur_f].emplace(s, splitSlots[cur_f].at(v)); 
+
+                for (size_t pred : blocks[h].preds) {
+                    if (option.liveIn && !inLoop[pred]) {
+                        insert_at_end(pred, arena.make<Instruction_assignment>(local, vars[c]), insertions); 
+                    }
+                }
+                for (size_t e : option.exits) {
+                    insert_at_start(e, arena.make<Instruction_assignment>(vars[c], local), insertions); 
+                }
+                for (size_t b : loop.blocks) {
+                    covered[c][b] = true; 
+                    for (size_t j = blocks[b].first; j <= blocks[b].last; j++) {
+                        if (functionLivenessData[j].gen.test(id) || functionLivenessData[j].kill.test(id)) {
+                            promotions[f.instructions[j]].emplace_back(v, local); 
+                        }
+                    }
+                }
+                // the new variable takes a register in this loop and in the loops around and inside it
+                for (size_t m = 0; m < cfg.loops.size(); m++) {
+                    const auto& mBlocks = cfg.loops[m].blocks; 
+                    if (inLoop[cfg.loops[m].header] || std::find(mBlocks.begin(), mBlocks.end(), h) != mBlocks.end()) {
+                        pressure[m]++; 
+                    }
+                }
+                promoted++; 
+            }
+        }
+        if (promoted > 0) {
+            L2_TRACE(TraceSpill, "promote " << f.name << ": " << promoted << " loop registers for spilled variables"); 
+        }
+        return promotions; 
+    }
+
+    /*
+     * spill() only rewrites instructions that mention a spilled variable, and the
+     * loads and stores it adds keep their temporaries inside one block. So the
+     * spilled variables just drop out of every set and the graph, and only blocks
+     * holding new instructions need their liveness and edges redone. Blocks that
+     * only lost instructions lost nothing but spilled variables.
+     */
+    void LivenessAnalysisBehavior::update_after_spill(const Program &p, const std::vector<Instruction*> &before, bool split) {
+        Function& f = *p.functions[cur_f]; 
+        std::vector<size_t> spilled; 
+        for (Symbol v : spillOutputs[cur_f]) {
+            spilled.push_back(itemIds[cur_f].at(v)); 
+        }
+
+        // Untouched instructions keep their gen and kill; only new ones are visited
+        std::unordered_map<const Instruction*, size_t> oldIndex; 
+        for (size_t j = 0; j < before.size(); j++) {
+            oldIndex.emplace(before[j], j); 
+        }
+        std::vector<livenessSets> oldData = std::move(livenessData[cur_f]); 
+        auto& functionLivenessData = livenessData[cur_f]; 
+        functionLivenessData.assign(f.instructions.size(), livenessSets{}); 
+        std::vector<bool> fresh(f.instructions.size(), false); 
+        for (cur_i = 0; cur_i < f.instructions.size(); cur_i++) {
+            auto it = oldIndex.find(f.instructions[cur_i]); 
+            if (it != oldIndex.end()) {
+                functionLivenessData[cur_i] = std::move(oldData[it->second]); 
+            } else {
+                fresh[cur_i] = true; 
+                f.instructions[cur_i]->accept(*this); 
+            }
+        }
+
+        size_t blockCount = cfgs[cur_f].blocks.size(); 
+        cfgs[cur_f] = build_cfg(f); 
+        if (cfgs[cur_f].blocks.size() == blockCount && !split) {
+            update_blocks_after_spill(spilled, fresh); 
+        } else {
+            // the rewrite is not supposed to change control flow, but start over if it did;
+            // split variables lose edges, which the incremental update can't take away
+            clear_function_containers(); 
+            f.accept(*this); 
+            generate_in_out_sets(p); 
+            generate_interference_graph(p); 
+        }
+
+        spillOutputs[cur_f].clear(); 
+        colorOutputs[cur_f].clear(); 
     }
         
 
-    std::string LivenessAnalysisBehavior::pick_low_node() {
-        size_t best = 0; 
-        std::string bestNode; 
-        bool found = false; 
-        for (const auto& [key, val] : nodeDegrees[cur_f]) {
-            if (!removed_nodes[cur_f].count(key) && val < 15) {
-                if (val > best || !found) {
-                    found = true; 
-                    best = val; 
-                    bestNode = key; 
+    void LivenessAnalysisBehavior::update_blocks_after_spill(const std::vector<size_t> &spilled, const std::vector<bool> &fresh) {
+        auto& functionLivenessData = livenessData[cur_f]; 
+        const auto& functionBlocks = cfgs[cur_f].blocks; 
+        size_t n = itemSymbols[cur_f].size(); 
+        auto resize_without_spilled = [&](livenessSets& ls) {
+            ls.gen.resize(n); 
+            ls.kill.resize(n); 
+            ls.in.resize(n); 
+            ls.out.resize(n); 
+            for (size_t id : spilled) {
+                ls.gen.reset(id); 
+                ls.kill.reset(id); 
+                ls.in.reset(id); 
+                ls.out.reset(id); 
+            }
+        }; 
+        for (auto& ls : functionLivenessData) {
+            resize_without_spilled(ls); 
+        }
+        std::vector<size_t> changed; 
+        for (size_t b = 0; b < functionBlocks.size(); b++) {
+            resize_without_spilled(blockLiveness[cur_f][b]); 
+            for (size_t j = functionBlocks[b].first; j <= functionBlocks[b].last; j++) {
+                if (fresh[j]) {
+                    changed.push_back(b); 
+                    break; 
                 }
             }
         }
-        return bestNode; 
+        for (size_t b : changed) {
+            summarize_block(b); 
+        }
+        std::vector<size_t> visited = solve_liveness(changed); 
+        for (size_t b : visited) {
+            generate_block_in_out_sets(b); 
+        }
+
+        auto& graph = interferenceGraph[cur_f]; 
+        for (size_t id : spilled) {
+            graph.remove_node(id); 
+        }
+        graph.grow(n); 
+        retiredNodes[cur_f].resize(n, false); 
+        for (size_t id : spilled) {
+            retiredNodes[cur_f][id] = true; 
+        }
+        for (size_t b : visited) {
+            add_block_edges(b); 
+        }
+        add_shift_edges(); 
+        compute_degrees(); 
+    }
+
+    // Spilled variables whose only def puts a constant in them; spill() recreates the constant at each use
+    std::unordered_map<Symbol, Item*> LivenessAnalysisBehavior::constant_variables() {
+        size_t n = itemSymbols[cur_f].size(); 
+        std::vector<size_t> defs(n, 0); 
+        std::vector<Item*> values(n, nullptr); 
+        for (const auto& ls : livenessData[cur_f]) {
+            ls.kill.for_each([&](size_t id) {
+                defs[id]++; 
+                values[id] = ls.constantSource; 
+            }); 
+        }
+        std::unordered_map<Symbol, Item*> constants; 
+        for (Symbol v : spillOutputs[cur_f]) {
+            size_t id = itemIds[cur_f].at(v); 
+            if (defs[id] == 1 && values[id] != nullptr) {
+                constants.emplace(v, values[id]); 
+            }
+        }
+        return constants; 
     }
 
-    std::string LivenessAnalysisBehavior::pick_high_node() {
-        size_t best = 0; 
-        std::string bestNode; 
-        bool found = false; 
-        for (const auto& [key, val] : nodeDegrees[cur_f]) {
-            if (!removed_nodes[cur_f].count(key)) {
-                if (val > best || !found) {
-                    found = true; 
-                    best = val; 
-                    bestNode = key; 
+    // Instructions where a caller-save register is live, like argument setup; spill temporaries left there could find no register
+    std::unordered_set<const Instruction*> LivenessAnalysisBehavior::crowded_instructions(const std::vector<Instruction*> &instructions) {
+        std::vector<RegisterID> caller_save_registers = {r10, r11, r8, r9, rax, rcx, rdi, rdx, rsi}; 
+        std::unordered_set<const Instruction*> crowded; 
+        for (size_t j = 0; j < livenessData[cur_f].size(); j++) {
+            const auto& ls = livenessData[cur_f][j]; 
+            for (RegisterID r : caller_save_registers) {
+                if (ls.in.test(r) || ls.out.test(r)) {
+                    crowded.insert(instructions[j]); 
+                    break; 
                 }
             }
         }
-        return bestNode; 
+        return crowded; 
     }
 
-    void LivenessAnalysisBehavior::update_graph(const std::string &selected) {
-        removed_nodes[cur_f].insert(selected); 
-        auto it = interferenceGraph[cur_f].find(selected); 
-        if (it == interferenceGraph[cur_f].end()) return; 
-        for (const auto& neigh : it -> second) {
-            if (removed_nodes[cur_f].count(neigh)) { continue ;} 
-            auto& d = nodeDegrees[cur_f][neigh]; 
-            if (d > 0) d--; 
+    // Each use or def counts 10^depth, so spill code in loops costs more; registers and spill temporaries can't spill
+    void LivenessAnalysisBehavior::compute_spill_costs() {
+        const CFG& cfg = cfgs[cur_f]; 
+        const auto& functionLivenessData = livenessData[cur_f]; 
+        auto& costs = spillCosts[cur_f]; 
+        costs.assign(itemSymbols[cur_f].size(), 0); 
+        for (size_t j = 0; j < functionLivenessData.size(); j++) {
+            double weight = block_frequency(cfg.blockOf[j]); 
+            auto add = [&](size_t id) { costs[id] += weight; }; 
+            functionLivenessData[j].gen.for_each(add); 
+            functionLivenessData[j].kill.for_each(add); 
+        }
+        for (size_t id = 0; id <= RegisterID::rsp; id++) {
+            costs[id] = std::numeric_limits<double>::infinity(); 
+        }
+        for (Symbol temp : spillTemps[cur_f]) {
+            auto it = itemIds[cur_f].find(temp); 
+            if (it != itemIds[cur_f].end()) {
+                costs[it->second] = std::numeric_limits<double>::infinity(); 
+            }
+        }
+    }
+
+    /*
+     * Conservative coalescing: the two sides of a copy that don't interfere are
+     * merged when that can't make the graph harder to color. Two variables need
+     * fewer than k significant neighbors together (Briggs); a variable joining a
+     * register needs each of its neighbors to be insignificant or to interfere
+     * with the register already (George). Merging works on a copy of the graph,
+     * since spilling updates the real one incrementally.
+     */
+    void LivenessAnalysisBehavior::coalesce_copies() {
+        auto& into = coalescedInto[cur_f]; 
+        into.clear(); 
+        const auto& functionLivenessData = livenessData[cur_f]; 
+        auto& graph = coalescedGraph[cur_f]; 
+        size_t merged = 0; 
+        for (const auto& ls : functionLivenessData) {
+            if (ls.copySource < 0) { continue; } 
+            size_t dst = 0; 
+            ls.kill.for_each([&](size_t id) { dst = id; }); 
+            size_t a = into.empty() ? dst : coalesced_node(dst); 
+            size_t b = into.empty() ? ls.copySource : coalesced_node(ls.copySource); 
+            // registers are the representatives of whatever joins them
+            if (b <= RegisterID::rsp) { std::swap(a, b); } 
+            if (!can_coalesce(a, b)) { continue; } 
+
+            if (into.empty()) {
+                graph = interferenceGraph[cur_f]; 
+                into.resize(graph.size()); 
+                for (size_t id = 0; id < into.size(); id++) {
+                    into[id] = id; 
+                }
+            }
+            std::vector<uint32_t> neighbors = graph.neighbors(b); 
+            graph.remove_node(b); 
+            for (size_t neigh : neighbors) {
+                graph.add_edge(a, neigh); 
+            }
+            into[b] = a; 
+            spillCosts[cur_f][a] += spillCosts[cur_f][b]; 
+            merged++; 
+        }
+        if (merged > 0) {
+            L2_TRACE(TraceLiveness, "liveness: coalesced " << merged << " copies"); 
+            for (size_t id = 0; id < graph.size(); id++) {
+                nodeDegrees[cur_f][id] = graph.degree(id); 
+            }
+        }
+    }
+
+    bool LivenessAnalysisBehavior::can_coalesce(size_t keep, size_t merge) {
+        const InterferenceGraph& graph = coloring_graph(); 
+        const auto& retired = retiredNodes[cur_f]; 
+        if (keep == merge || merge <= RegisterID::rsp || keep == RegisterID::rsp) { return false; } 
+        if (retired[keep] || retired[merge] || graph.interferes(keep, merge)) { return false; } 
+        // a spill temporary can't be spilled again, so it only joins registers
+        auto& temps = spillTemps[cur_f]; 
+        if (keep > RegisterID::rsp && (temps.count(itemSymbols[cur_f][keep]) || temps.count(itemSymbols[cur_f][merge]))) {
+            return false; 
+        }
+
+        size_t k = GPregisters.size(); 
+        if (keep <= RegisterID::rsp) {
+            for (size_t neigh : graph.neighbors(merge)) {
+                if (graph.degree(neigh) >= k && !graph.interferes(neigh, keep)) { return false; } 
+            }
+            return true; 
+        }
+        size_t significant = 0; 
+        auto count = [&](size_t neigh, size_t other) {
+            // a common neighbor loses one edge in the merge
+            size_t d = graph.degree(neigh) - (graph.interferes(neigh, other) ? 1 : 0); 
+            if (d >= k) { significant++; } 
+        }; 
+        for (size_t neigh : graph.neighbors(keep)) {
+            count(neigh, merge); 
+        }
+        for (size_t neigh : graph.neighbors(merge)) {
+            if (!graph.interferes(neigh, keep)) { count(neigh, keep); } 
+        }
+        return significant < k; 
+    }
+
+    size_t LivenessAnalysisBehavior::coalesced_node(size_t id) {
+        auto& into = coalescedInto[cur_f]; 
+        while (into[id] != id) {
+            id = into[id]; 
+        }
+        return id; 
+    }
+
+    const InterferenceGraph& LivenessAnalysisBehavior::coloring_graph() {
+        return coalescedInto[cur_f].empty() ? interferenceGraph[cur_f] : coalescedGraph[cur_f]; 
+    }
+
+    long LivenessAnalysisBehavior::pick_low_node() {
+        // the first node with fewer neighbors than there are colors
+        long k = GPregisters.size(); 
+        auto it = degreeQueue[cur_f].lower_bound({-(k - 1), 0}); 
+        return it == degreeQueue[cur_f].end() ? -1 : static_cast<long>(it->second); 
+    }
+
+    // Everything left has k or more neighbors: take the node that is cheapest to spill per neighbor
+    long LivenessAnalysisBehavior::pick_high_node() {
+        auto& queue = spillQueue[cur_f]; 
+        return queue.empty() ? -1 : static_cast<long>(std::get<2>(*queue.begin())); 
+    }
+
+    // Ties go to the higher degree, then the lower ID; a node without neighbors is never a high pick
+    std::tuple<double, long, size_t> LivenessAnalysisBehavior::spill_queue_key(size_t node, size_t degree) {
+        double weight = degree == 0 ? std::numeric_limits<double>::infinity() : spillCosts[cur_f][node] / degree; 
+        return {weight, -static_cast<long>(degree), node}; 
+    }
+
+    void LivenessAnalysisBehavior::queue_node(size_t node, size_t degree) {
+        degreeQueue[cur_f].insert({-static_cast<long>(degree), node}); 
+        spillQueue[cur_f].insert(spill_queue_key(node, degree)); 
+    }
+
+    void LivenessAnalysisBehavior::unqueue_node(size_t node, size_t degree) {
+        degreeQueue[cur_f].erase({-static_cast<long>(degree), node}); 
+        spillQueue[cur_f].erase(spill_queue_key(node, degree)); 
+    }
+
+    void LivenessAnalysisBehavior::update_graph(size_t selected) {
+        auto& functionNodeDegrees = nodeDegrees[cur_f]; 
+        removed_nodes[cur_f][selected] = true; 
+        unqueue_node(selected, functionNodeDegrees[selected]); 
+        for (size_t neigh : coloring_graph().neighbors(selected)) {
+            if (removed_nodes[cur_f][neigh]) { continue ;} 
+            auto& d = functionNodeDegrees[neigh]; 
+            if (d == 0) { continue; } 
+            unqueue_node(neigh, d); 
+            d--; 
+            queue_node(neigh, d); 
         }
     }
 
     void LivenessAnalysisBehavior::select_nodes() {
+        // rsp is never allocated and spilled variables are gone, so neither is a node
         auto& functionNodeDegrees = nodeDegrees[cur_f]; 
+        removed_nodes[cur_f] = retiredNodes[cur_f]; 
+        removed_nodes[cur_f][RegisterID::rsp] = true; 
+        // merged nodes are colored along with the node they joined
+        auto& into = coalescedInto[cur_f]; 
+        for (size_t id = 0; id < into.size(); id++) {
+            if (into[id] != id) {
+                removed_nodes[cur_f][id] = true; 
+            }
+        }
+        for (size_t id = 0; id < functionNodeDegrees.size(); id++) {
+            if (!removed_nodes[cur_f][id]) {
+                queue_node(id, functionNodeDegrees[id]); 
+            }
+        }
         bool hasPick = true; 
         while (hasPick) {
-            std::string selected; 
-            std::string low_node = pick_low_node();
-            if (low_node.empty()) {
-                std::string high_node = pick_high_node();
-                if (high_node.empty()) {
-                    hasPick = false; 
-                } else {
-                    selected = high_node; 
-                    node_stack[cur_f].push_back(high_node); 
-                }
-            } else {
-                selected = low_node; 
-                node_stack[cur_f].push_back(low_node); 
+            long selected = pick_low_node();
+            if (selected < 0) {
+                selected = pick_high_node();
             }
-            if (!selected.empty()) {
+            if (selected < 0) {
+                hasPick = false; 
+            } else {
+                node_stack[cur_f].push_back(selected); 
                 update_graph(selected); 
             }
         }
     } 
 
-    bool LivenessAnalysisBehavior::color_or_spill_node(const std::string &cur_node, const std::unordered_set<std::string> &neighbors) {
-        for (const auto& color : colorOrder) {
-            bool found = true; 
-            for (const auto& neigh : neighbors) {
-                if (color == neigh || (colorOutputs[cur_f].count(neigh) && color == colorOutputs[cur_f].at(neigh))) {
-                    found = false; 
-                    break; 
-                }
+    bool LivenessAnalysisBehavior::color_or_spill_node(size_t cur_node, const std::vector<uint32_t> &neighbors) {
+        auto& functionNodeColors = nodeColors[cur_f]; 
+        // registers are precolored
+        if (cur_node <= RegisterID::rsp) {
+            functionNodeColors[cur_node] = cur_node; 
+            return false; 
+        }
+        uint16_t forbidden = 0; 
+        for (size_t neigh : neighbors) {
+            // a register forbids itself even before it is popped
+            int color = neigh <= RegisterID::rsp ? static_cast<int>(neigh) : functionNodeColors[neigh]; 
+            if (color >= 0) {
+                forbidden |= 1u << color; 
             }
-            if (found) {
-                colorOutputs[cur_f][cur_node] = color;
+        }
+        Symbol var = itemSymbols[cur_f][cur_node]; 
+        for (RegisterID color : colorOrder) {
+            if (!(forbidden & (1u << color))) {
+                functionNodeColors[cur_node] = color; 
+                colorOutputs[cur_f][var] = color;
                 return false; 
             }
         }
-        bool isSpillTemp = cur_node.size() >= 2 && cur_node[1] == 'S'; 
-        if (!isSpillTemp) {
-            spillOutputs[cur_f].insert(cur_node);
+        // a spill temporary can't spill; with nothing spilled allocate_function gives up
+        if (!spillTemps[cur_f].count(var)) {
+            spillOutputs[cur_f].insert(var);
         } 
         return true; 
     }
 
     bool LivenessAnalysisBehavior::color_graph() {
+        compute_spill_costs(); 
+        coalesce_copies(); 
         select_nodes(); 
+        nodeColors[cur_f].assign(nodeDegrees[cur_f].size(), -1); 
         auto& functionNodeStack = node_stack[cur_f]; 
-        auto& functionInterferenceGraph = interferenceGraph[cur_f]; 
+        const InterferenceGraph& graph = coloring_graph(); 
         bool spill = false; 
         while (!functionNodeStack.empty()) {
-            std::string cur_node = functionNodeStack.back(); 
+            size_t cur_node = functionNodeStack.back(); 
             functionNodeStack.pop_back(); 
-            if (color_or_spill_node(cur_node, functionInterferenceGraph[cur_node])) {
+            if (color_or_spill_node(cur_node, graph.neighbors(cur_node))) {
                 spill = true;
             } 
         }
+        auto& into = coalescedInto[cur_f]; 
+        for (size_t id = RegisterID::rsp + 1; id < into.size(); id++) {
+            int color = nodeColors[cur_f][coalesced_node(id)]; 
+            if (into[id] != id && color >= 0) {
+                nodeColors[cur_f][id] = color; 
+                colorOutputs[cur_f][itemSymbols[cur_f][id]] = static_cast<RegisterID>(color); 
+            }
+        }
         if (spill) {
             return false; 
         }
@@ -536,13 +1253,13 @@ namespace L2{
             for (size_t i = 0; i < livenessData[f].size(); ++i) {
             const auto& ls = livenessData[f][i];
 
-            auto printSet = [](const std::unordered_set<std::string>& s) {
+            auto printSet = [&](const BitVector& s) {
                 bool first = true;
-                for (const auto& x : s) {
+                s.for_each([&](size_t id) {
                 if (!first) std::cout << ", ";
-                std::cout << x;
+                std::cout << item_name(f, id);
                 first = false;
-                }
+                });
             };
 
             std::cout << "  Instr " << i << "\n";
@@ -558,14 +1275,15 @@ namespace L2{
         }
     }
 
-    void LivenessAnalysisBehavior::print_paren_set(const std::unordered_set<std::string>& s) {
+    void LivenessAnalysisBehavior::print_paren_set(const BitVector& s) {
         if (s.empty()) {
             out << "()\n";
             return;
         }
 
         // alphabetical order
-        std::vector<std::string> v(s.begin(), s.end());
+        std::vector<std::string> v;
+        s.for_each([&](size_t id) { v.push_back(item_name(cur_f, id)); });
         std::sort(v.begin(), v.end());
 
         out << "(";
@@ -600,28 +1318,81 @@ namespace L2{
 
     void LivenessAnalysisBehavior::print_interference_tests() {
         const size_t f = 0; 
-        std::vector<std::string> keys; 
-        std::transform(interferenceGraph[f].begin(), interferenceGraph[f].end(), std::back_inserter(keys), [](const auto& m) {return m.first;});
+        auto& graph = interferenceGraph[f]; 
+        std::vector<std::pair<std::string, size_t>> keys; 
+        for (size_t id = 0; id < graph.size(); id++) {
+            if (id != RegisterID::rsp && !retiredNodes[f][id]) {
+                keys.emplace_back(item_name(f, id), id); 
+            }
+        }
         std::sort(keys.begin(), keys.end()); 
-        for (auto& key: keys) {
+        for (auto& [key, id]: keys) {
             std::vector<std::string> keyConnects; 
-            auto& neighSet = interferenceGraph[f].at(key); 
-            std::transform(neighSet.begin(), neighSet.end(), std::back_inserter(keyConnects), [](const auto& s) {return s;});
+            for (size_t neigh : graph.neighbors(id)) {
+                keyConnects.push_back(item_name(f, neigh)); 
+            }
             std::sort(keyConnects.begin(), keyConnects.end()); 
             out << key;
             for (const auto& neigh : keyConnects) {
-                if (neigh == key) continue;      
-                    out << " " << neigh;
-                }
+                out << " " << neigh;
+            }
             out << "\n";                    
         }
     }
 
-    void analyze_liveness(Program& p) {
+    std::vector<functionAllocation> analyze_liveness(Program& p, bool printLiveness, bool printInterference, size_t jobs) {
+        // the printed tests are about the first function only, so they stay serial
+        if (jobs <= 1 || printLiveness || printInterference) {
+            LivenessAnalysisBehavior b(std::cout, printLiveness, printInterference);
+            p.accept(b); 
+            return b.allocations();
+        }
+
+        // Functions are independent: each worker takes the next unallocated one with
+        // its own behavior and arena, and results land at the function's index.
+        size_t n = p.functions.size(); 
+        std::vector<functionAllocation> result(n); 
+        std::vector<Arena> arenas(jobs); 
+        std::vector<std::exception_ptr> errors(n); 
+        std::atomic<size_t> next{0}; 
+        std::vector<std::thread> workers; 
+        for (size_t t = 0; t < jobs; t++) {
+            workers.emplace_back([&, t] {
+                LivenessAnalysisBehavior b(std::cout, false, false); 
+                b.initialize_containers(n); 
+                for (size_t f = next++; f < n; f = next++) {
+                    try {
+                        b.allocate_function(p, f, arenas[t]); 
+                        result[f] = b.allocation(f); 
+                    } catch (...) {
+                        errors[f] = std::current_exception(); 
+                    }
+                    b.release_function(f); 
+                }
+            }); 
+        }
+        for (auto& w : workers) {
+            w.join(); 
+        }
+        // rethrow what a serial run would have hit first
+        for (auto& e : errors) {
+            if (e) { std::rethrow_exception(e); }
+        }
+        for (auto& a : arenas) {
+            p.arena.adopt(std::move(a)); 
+        }
+        return result; 
+    }
 
-        LivenessAnalysisBehavior b(std::cout);
-        p.accept(b); 
+    std::vector<functionAllocation> LivenessAnalysisBehavior::allocations() {
+        std::vector<functionAllocation> result; 
+        for (size_t f = 0; f < colorOutputs.size(); f++) {
+            result.push_back(allocation(f)); 
+        }
+        return result; 
+    }
 
-        return;
+    functionAllocation LivenessAnalysisBehavior::allocation(size_t f) {
+        return functionAllocation{colorOutputs[f], spillCounters[f]}; 
     }
 }
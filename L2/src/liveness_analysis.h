@@ -1,29 +1,58 @@
 #pragma once
 
 #include <algorithm> 
+#include <atomic> 
+#include <deque> 
 #include <iterator> 
+#include <set> 
+#include <thread> 
+#include <tuple> 
 #include <unordered_map> 
 #include <unordered_set> 
 #include <vector> 
 #include <behavior.h>
+#include <bit_vector.h>
+#include <cfg.h>
+#include <interference_graph.h>
 #include <spill.h> 
+#include <stack_slots.h> 
 #include <helper.h> 
+#include <trace.h>
 #include <L2.h>
 
 namespace L2{
 
+  // Sets are indexed by per-function item IDs, see LivenessAnalysisBehavior::itemId
   struct livenessSets {
-    std::unordered_set<std::string> gen; 
-    std::unordered_set<std::string> kill; 
-    std::unordered_set<std::string> in; 
-    std::unordered_set<std::string> out; 
+    BitVector gen; 
+    BitVector kill; 
+    BitVector in; 
+    BitVector out; 
+    // w <- x between registers or variables: the ID of x, -1 for anything else
+    long copySource = -1; 
+    // w <- N, a label or a function: that value
+    Item* constantSource = nullptr; 
+  };
+
+  // Instructions to add ahead of and after each instruction of a function
+  struct Insertions {
+    explicit Insertions(size_t n) : before(n), after(n) {}
+    std::vector<std::vector<Instruction*>> before; 
+    std::vector<std::vector<Instruction*>> after; 
+  };
+
+  // Result of register allocation for one function
+  struct functionAllocation {
+    std::unordered_map<Symbol, RegisterID> coloring; 
+    size_t locals; 
   };
 
   class LivenessAnalysisBehavior : public Behavior {
     public: 
-      explicit LivenessAnalysisBehavior(std::ostream &out);
+      explicit LivenessAnalysisBehavior(std::ostream &out, bool printLiveness = false, bool printInterference = true);
       void act(Program& p) override; 
       void act(Function &f) override; 
+      void allocate_function(Program& p, size_t i, Arena& arena); 
       void act(Instruction_assignment &i) override; 
       virtual void act(Instruction_stack_arg_assignment &i) override; 
       virtual void act(Instruction_aop &i) override; 
@@ -40,55 +69,119 @@ namespace L2{
 
       void print_instruction_gen_kill(size_t cur_i, const livenessSets& ls);
       void print_in_out_sets();
-      void print_paren_set(const std::unordered_set<std::string>& s);
+      void print_paren_set(const BitVector& s);
+      std::string item_name(size_t f, size_t id);
       void print_liveness_tests();
       void print_interference_tests();
 
       void initialize_containers(size_t n); 
       void clear_function_containers();
+      // Frees function f's working state; its coloring and locals stay for allocation()
+      void release_function(size_t f); 
 
       bool isVariable(const Item* var);
       bool isLivenessContributor(const Item* var); 
-      bool isNoSuccessorInstruction(const Instruction* i);
 
-      void collectVar(const Item* var); 
+      size_t itemId(const Item* var); 
 
       void generate_in_out_sets(const Program &p); 
+      void summarize_block(size_t b); 
+      std::vector<size_t> solve_liveness(const std::vector<size_t> &seeds); 
+      void generate_instruction_in_out_sets(); 
+      void generate_block_in_out_sets(size_t b); 
+      void add_edges(const BitVector& A, const BitVector& B); 
+      void add_block_edges(size_t b); 
+      void add_shift_edges(); 
+      void compute_degrees(); 
       void generate_interference_graph(const Program &p); 
-
-      std::string pick_low_node(); 
-      std::string pick_high_node(); 
-      void update_graph(const std::string &selected); 
+      std::vector<size_t> loops_outermost_first(); 
+      std::vector<size_t> loop_pressure(const std::vector<size_t> &excluded); 
+      double block_frequency(size_t b); 
+      void insert_at_end(size_t pred, Instruction* i, Insertions &insertions); 
+      void insert_at_start(size_t exit, Instruction* i, Insertions &insertions); 
+      void insert_instructions(Function &f, const Insertions &insertions); 
+      bool split_around_loops(const Program &p, Arena &arena, const std::unordered_map<Symbol, Item*> &constants, Insertions &insertions); 
+      LoopPromotions promote_in_loops(const Program &p, Arena &arena, const std::unordered_map<Symbol, Item*> &constants, Insertions &insertions); 
+      void update_after_spill(const Program &p, const std::vector<Instruction*> &before, bool split); 
+      void update_blocks_after_spill(const std::vector<size_t> &spilled, const std::vector<bool> &fresh); 
+
+      std::unordered_map<Symbol, Item*> constant_variables(); 
+      std::unordered_set<const Instruction*> crowded_instructions(const std::vector<Instruction*> &instructions); 
+      void compute_spill_costs(); 
+      void coalesce_copies(); 
+      bool can_coalesce(size_t keep, size_t merge); 
+      size_t coalesced_node(size_t id); 
+      const InterferenceGraph& coloring_graph(); 
+
+      long pick_low_node(); 
+      long pick_high_node(); 
+      std::tuple<double, long, size_t> spill_queue_key(size_t node, size_t degree); 
+      void queue_node(size_t node, size_t degree); 
+      void unqueue_node(size_t node, size_t degree); 
+      void update_graph(size_t selected); 
       void select_nodes(); 
 
-      bool color_or_spill_node(const std::string &cur_node, const std::unordered_set<std::string> &neighbors); 
+      bool color_or_spill_node(size_t cur_node, const std::vector<uint32_t> &neighbors); 
       bool color_graph(); 
 
+      std::vector<functionAllocation> allocations(); 
+      functionAllocation allocation(size_t f); 
+
  
     private: 
       size_t cur_f = 0; 
       size_t cur_i = 0; 
 
-      std::vector<std::unordered_set<std::string>> variables; 
+      // Dense IDs for registers and variables; registers take IDs 0..15 in RegisterID order
+      std::vector<std::vector<Symbol>> itemSymbols; 
+      std::vector<std::unordered_map<Symbol, size_t>> itemIds; 
 
       std::vector<std::vector<livenessSets>> livenessData; 
-      std::vector<std::unordered_map<std::string, size_t>> labelMap; 
-      std::vector<std::unordered_map<std::string, std::unordered_set<std::string>>> interferenceGraph; 
-
-      std::vector<std::unordered_map<std::string, size_t>> nodeDegrees; 
-      std::vector<std::unordered_set<std::string>> removed_nodes; 
-      std::vector<std::vector<std::string>> node_stack; 
+      std::vector<CFG> cfgs; 
+      std::vector<std::vector<livenessSets>> blockLiveness; 
+      std::vector<std::vector<size_t>> shiftSources; 
+      // Nodes are item IDs
+      std::vector<InterferenceGraph> interferenceGraph; 
+      // Spilled variables keep their IDs but are no longer nodes
+      std::vector<std::vector<bool>> retiredNodes; 
+
+      // Copy-related nodes merged for one coloring round; empty when nothing was merged
+      std::vector<InterferenceGraph> coalescedGraph; 
+      std::vector<std::vector<size_t>> coalescedInto; 
+
+      // Uses and defs weighted by loop depth; what spilling a node would cost
+      std::vector<std::vector<double>> spillCosts; 
+
+      std::vector<std::vector<size_t>> nodeDegrees; 
+      // Nodes not yet removed, ordered by degree (highest first) and then by ID
+      std::vector<std::set<std::pair<long, size_t>>> degreeQueue; 
+      // The same nodes ordered by spill cost per neighbor (cheapest first), then as in degreeQueue
+      std::vector<std::set<std::tuple<double, long, size_t>>> spillQueue; 
+      // Register each node got, -1 while uncolored
+      std::vector<std::vector<int>> nodeColors; 
+      std::vector<std::vector<bool>> removed_nodes; 
+      std::vector<std::vector<size_t>> node_stack; 
  
-      std::vector<std::unordered_set<std::string>> spillOutputs; 
-      std::vector<std::unordered_map<std::string, std::string>> colorOutputs; 
+      std::vector<std::unordered_set<Symbol>> spillOutputs; 
+      std::vector<std::unordered_set<Symbol>> spillTemps; 
+      // Variables already split around loops and their slots; if they still don't fit they are spilled there
+      std::vector<std::unordered_map<Symbol, int64_t>> splitSlots; 
+      // The mem rsp items of spill slots; the program's own rsp accesses are never among them
+      std::vector<std::unordered_set<const Item*>> slotItems; 
+      // Spilled variables that got a register of their own in a loop, and those loop variables; neither is promoted again
+      std::vector<std::unordered_set<Symbol>> loopVariables; 
+      std::vector<std::unordered_map<Symbol, RegisterID>> colorOutputs; 
 
       std::vector<size_t> tempCounters;
       std::vector<size_t> spillCounters; 
 
+      bool printLiveness; 
+      bool printInterference; 
       std::ostream &out; 
   }; 
 
 
-    void analyze_liveness(Program& p); 
+    // jobs > 1 allocates functions on that many threads
+    std::vector<functionAllocation> analyze_liveness(Program& p, bool printLiveness, bool printInterference, size_t jobs = 1); 
 
 }
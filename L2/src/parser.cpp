@@ -30,6 +30,7 @@
 #include <L2.h>
 #include <parser.h>
 #include <helper.h> 
+#include <trace.h>
 
 namespace pegtl = TAO_PEGTL_NAMESPACE;
 
@@ -569,28 +570,33 @@ struct Instruction_rule:
   > {};
 
 
+  // Any line but the function's closing paren has to be an instruction, so a bad one is reported where it is
   struct Instructions_rule:
     pegtl::plus<
       pegtl::seq<
         seps,
         pegtl::bol,
         spaces,
-        Instruction_rule,
+        pegtl::not_at< pegtl::one< ')' > >,
+        pegtl::must< Instruction_rule >,
         seps
       >
     > { };
 
+  // Past its opening paren a function has to be complete
   struct Function_rule:
     pegtl::seq<
       pegtl::seq<spaces, pegtl::one< '(' >>,
-      seps_with_comments,
-      pegtl::seq<spaces, function_name_rule>,
-      seps_with_comments,
-      pegtl::seq<spaces, argument_number>,
-      seps_with_comments,
-      Instructions_rule,
-      seps_with_comments,
-      pegtl::seq<spaces, pegtl::one< ')' >>
+      pegtl::must<
+        seps_with_comments,
+        pegtl::seq<spaces, function_name_rule>,
+        seps_with_comments,
+        pegtl::seq<spaces, argument_number>,
+        seps_with_comments,
+        Instructions_rule,
+        seps_with_comments,
+        pegtl::seq<spaces, pegtl::one< ')' >>
+      >
     > {};
 
   struct Functions_rule:
@@ -600,22 +606,51 @@ struct Instruction_rule:
       seps_with_comments
     > {};
 
+  // Only tried once program_start_rule matched, so the functions and the closing paren have to follow
   struct entry_point_rule:
+    pegtl::seq<
+      seps_with_comments,
+      pegtl::seq<spaces, pegtl::one< '(' >>,
+      seps_with_comments,
+      function_name_rule,
+      pegtl::must<
+        seps_with_comments,
+        Functions_rule,
+        seps_with_comments,
+        pegtl::seq<spaces, pegtl::one< ')' >>,
+        seps
+      >
+    > { };
+
+  // A whole program opens with its entry point name followed by a function
+  struct program_start_rule:
     pegtl::seq<
       seps_with_comments,
       pegtl::seq<spaces, pegtl::one< '(' >>,
       seps_with_comments,
       function_name_rule,
       seps_with_comments,
+      pegtl::seq<spaces, pegtl::one< '(' >>
+    > { };
+
+  // Matches nothing; its action makes @go the entry point of a function-only file
+  struct go_entry_point_rule:
+    pegtl::success { };
+
+  struct functions_file_rule:
+    pegtl::seq<
+      go_entry_point_rule,
       Functions_rule,
-      seps_with_comments,
-      pegtl::seq<spaces, pegtl::one< ')' >>,
-      seps
+      seps_with_comments
     > { };
 
+  // Function tests give a lone function, which is compiled as if wrapped in (@go ...)
   struct grammar : 
     pegtl::must< 
-      entry_point_rule
+      pegtl::sor<
+        pegtl::seq< pegtl::at< program_start_rule >, entry_point_rule >,
+        functions_file_rule
+      >
     > {};
 
   /* 
@@ -630,22 +665,30 @@ struct Instruction_rule:
   template<> struct action < function_name_rule > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
+      L2_TRACE(TraceParse, "function " << in.string_view()); 
       if (p.entryPointLabel.empty()){
         p.entryPointLabel = in.string();
       } else {
-        auto newF = new Function();
+        auto newF = p.arena.make<Function>();
         newF->name = in.string();
         p.functions.push_back(newF);
       }
     }
   };
     
+  template<> struct action < go_entry_point_rule > {
+    template< typename Input >
+	  static void apply( const Input & in, Program & p){
+      p.entryPointLabel = "@go";
+    }
+  };
+
   template<> struct action < argument_number > {
     template< typename Input >
 	  static void apply( const Input & in, Program & p){
 
       auto currentF = p.functions.back();
-      currentF->arguments = std::stoll(in.string());
+      currentF->arguments = number_from_string(in.string_view());
     }
   };
   
@@ -655,7 +698,7 @@ struct Instruction_rule:
   template<> struct action<variable_rule> {
     template<typename Input>
     static void apply(const Input& in, Program& p) { 
-      auto v = new Variable(in.string()); 
+      auto v = p.arena.make<Variable>(intern(in.string_view())); 
       parsed_items.push_back(v); }
   };
 
@@ -665,44 +708,44 @@ struct Instruction_rule:
   template<> struct action<register_rax_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      parsed_items.push_back(new Register(RegisterID::rax)); }
+      parsed_items.push_back(canonical_register(RegisterID::rax)); }
   };
 
   template<> struct action<register_rdi_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      parsed_items.push_back(new Register(RegisterID::rdi)); }
+      parsed_items.push_back(canonical_register(RegisterID::rdi)); }
   };
 
   template<> struct action<register_rsi_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rsi)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rsi)); }
   };
 
   template<> struct action<register_rdx_rule> {
     template<typename Input>
     static void apply(const Input&, Program&) { 
-      parsed_items.push_back(new Register(RegisterID::rdx)); }
+      parsed_items.push_back(canonical_register(RegisterID::rdx)); }
   };
 
   template<> struct action<register_rcx_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rcx)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rcx)); }
   };
 
   template<> struct action<register_r8_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r8)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r8)); }
   };
 
   template<> struct action<register_r9_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::r9)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::r9)); }
   };
 
   template<> struct action<register_rsp_rule> {
     template<typename Input>
-    static void apply(const Input&, Program&) { parsed_items.push_back(new Register(RegisterID::rsp)); }
+    static void apply(const Input&, Program&) { parsed_items.push_back(canonical_register(RegisterID::rsp)); }
   };
 
 
@@ -710,7 +753,7 @@ struct Instruction_rule:
   template<> struct action < number > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto n = new Number(static_cast<uint64_t>(std::stoull(in.string())));
+      auto n = make_number(p.arena, number_from_string(in.string_view()));
       parsed_items.push_back(n);
     }
   };
@@ -719,7 +762,7 @@ struct Instruction_rule:
   template<> struct action < label_piece > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto l = new Label(in.string());
+      auto l = p.arena.make<Label>(intern(in.string_view()));
       parsed_items.push_back(l);
     }
   };
@@ -728,7 +771,7 @@ struct Instruction_rule:
   template<> struct action < function_name_piece_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      auto f = new Func(in.string());
+      auto f = p.arena.make<Func>(intern(in.string_view()));
       parsed_items.push_back(f);
     }
   };
@@ -737,7 +780,7 @@ struct Instruction_rule:
   template<> struct action < aop_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_aop = aop_from_string(in.string()); 
+      last_aop = aop_from_string(in.string_view()); 
     }
   };
 
@@ -745,7 +788,7 @@ struct Instruction_rule:
   template<> struct action < sop_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_sop = sop_from_string(in.string()); 
+      last_sop = sop_from_string(in.string_view()); 
     }
   };
 
@@ -754,7 +797,7 @@ struct Instruction_rule:
   template<> struct action < cmp_rule > {
     template< typename Input >
     static void apply (const Input &in, Program &p) {
-      last_cmp = cmp_from_string(in.string()); 
+      last_cmp = cmp_from_string(in.string_view()); 
     }
   };
 
@@ -781,7 +824,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(dst, src);
+      auto i = p.arena.make<Instruction_assignment>(dst, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -813,12 +856,12 @@ struct Instruction_rule:
       auto dst = parsed_items.back();
       parsed_items.pop_back();
 
-      auto mem = new Memory(src, static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(src, static_cast<Number*> (num));
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(dst, mem);
+      auto i = p.arena.make<Instruction_assignment>(dst, mem);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -848,12 +891,12 @@ struct Instruction_rule:
       auto dst = parsed_items.back();
       parsed_items.pop_back();
 
-      auto mem = new Memory(dst, static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(dst, static_cast<Number*> (num));
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_assignment(mem, src);
+      auto i = p.arena.make<Instruction_assignment>(mem, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -882,12 +925,12 @@ struct Instruction_rule:
       auto dst = parsed_items.back();
       parsed_items.pop_back();
 
-      auto stackarg = new StackArg(static_cast<Number*>(offset)); 
+      auto stackarg = p.arena.make<StackArg>(static_cast<Number*>(offset)); 
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_stack_arg_assignment(dst, stackarg);
+      auto i = p.arena.make<Instruction_stack_arg_assignment>(dst, stackarg);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -919,7 +962,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_aop(dst, last_aop, rhs);
+      auto i = p.arena.make<Instruction_aop>(dst, last_aop, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -950,7 +993,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_sop(dst, last_sop, rhs);
+      auto i = p.arena.make<Instruction_sop>(dst, last_sop, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -983,13 +1026,13 @@ struct Instruction_rule:
       parsed_items.pop_back();
 
 
-      auto mem = new Memory(dst, static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(dst, static_cast<Number*> (num));
 
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_mem_aop(mem, last_aop, src);
+      auto i = p.arena.make<Instruction_mem_aop>(mem, last_aop, src);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1022,13 +1065,13 @@ struct Instruction_rule:
       parsed_items.pop_back();
 
 
-      auto mem = new Memory(src, static_cast<Number*> (num));
+      auto mem = p.arena.make<Memory>(src, static_cast<Number*> (num));
 
 
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_mem_aop(dst, last_aop, mem);
+      auto i = p.arena.make<Instruction_mem_aop>(dst, last_aop, mem);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1063,7 +1106,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_cmp_assignment(dst, lhs, last_cmp, rhs);
+      auto i = p.arena.make<Instruction_cmp_assignment>(dst, lhs, last_cmp, rhs);
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1099,7 +1142,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_cjump(lhs, last_cmp, rhs, static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_cjump>(lhs, last_cmp, rhs, static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1130,7 +1173,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_label(static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_label>(static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1160,7 +1203,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_goto(static_cast<Label*>(label));
+      auto i = p.arena.make<Instruction_goto>(static_cast<Label*>(label));
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1174,7 +1217,7 @@ struct Instruction_rule:
 	  static void apply( const Input & in, Program & p){
 
       auto currentF = p.functions.back();
-      auto i = new Instruction_ret();
+      auto i = p.arena.make<Instruction_ret>();
       currentF->instructions.push_back(i);
     }
   };
@@ -1202,7 +1245,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::l1, callee, static_cast<Number*>(nArgs)); 
+      auto i = p.arena.make<Instruction_call>(CallType::l1, callee, static_cast<Number*>(nArgs)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1225,7 +1268,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::print, nullptr, new Number(1)); 
+      auto i = p.arena.make<Instruction_call>(CallType::print, nullptr, make_number(p.arena, 1)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1248,7 +1291,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::input, nullptr, new Number(0)); 
+      auto i = p.arena.make<Instruction_call>(CallType::input, nullptr, make_number(p.arena, 0)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1269,7 +1312,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::allocate, nullptr, new Number(2)); 
+      auto i = p.arena.make<Instruction_call>(CallType::allocate, nullptr, make_number(p.arena, 2)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1291,7 +1334,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::tuple_error, nullptr, new Number(3)); 
+      auto i = p.arena.make<Instruction_call>(CallType::tuple_error, nullptr, make_number(p.arena, 3)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1320,7 +1363,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_call(CallType::tensor_error, nullptr, static_cast<Number*>(number)); 
+      auto i = p.arena.make<Instruction_call>(CallType::tensor_error, nullptr, static_cast<Number*>(number)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1351,7 +1394,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_reg_inc_dec(dst, IncDec::increment); 
+      auto i = p.arena.make<Instruction_reg_inc_dec>(dst, IncDec::increment); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1381,7 +1424,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_reg_inc_dec(dst, IncDec::decrement); 
+      auto i = p.arena.make<Instruction_reg_inc_dec>(dst, IncDec::decrement); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1418,7 +1461,7 @@ struct Instruction_rule:
       /* 
        * Create the instruction.
        */ 
-      auto i = new Instruction_lea(dst, lhs, rhs, static_cast<Number*>(number)); 
+      auto i = p.arena.make<Instruction_lea>(dst, lhs, rhs, static_cast<Number*>(number)); 
 
       /* 
        * Add the just-created instruction to the current function.
@@ -1428,23 +1471,37 @@ struct Instruction_rule:
   };
 
 
-  Program parse_file (char *fileName){
-
-    /* 
-     * Check the grammar for some possible issues.
-     */
+  /* 
+   * Check the grammar for some possible issues. This walks the whole grammar, so it
+   * only runs when asked for rather than on every parse.
+   */
+  void check_grammar (){
     if (pegtl::analyze< grammar >() != 0){
       std::cerr << "There are problems with the grammar" << std::endl;
       exit(1);
     }
+  }
+
+  template< typename Input >
+  static Program parse_input (Input &input){
 
     /*
      * Parse.
      */
-    file_input< > fileInput(fileName);
     Program p;
-    parse< grammar, action >(fileInput, p);
+    parsed_items.clear();
+    parse< grammar, action >(input, p);
 
     return p;
   }
+
+  Program parse_file (char *fileName){
+    mmap_input< > fileInput(fileName);
+    return parse_input(fileInput);
+  }
+
+  Program parse_string (const std::string &source, const std::string &sourceName){
+    memory_input< > memoryInput(source, sourceName);
+    return parse_input(memoryInput);
+  }
 }
@@ -1,7 +1,13 @@
 #pragma once 
 
+#include <string>
+
 #include <L2.h>
 
 namespace L2 {
+    // Debug check of the grammar itself, not of any input
+    void check_grammar(); 
     Program parse_file(char* fileName); 
+    // Parses source already in memory; sourceName only shows up in error positions
+    Program parse_string(const std::string &source, const std::string &sourceName = "input"); 
 }
\ No newline at end of file
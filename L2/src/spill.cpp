@@ -1,11 +1,19 @@
 #include <spill.h> 
+#include <trace.h>
 
 namespace L2 {
-    SpillBehavior::SpillBehavior(const std::unordered_set<std::string> &spillInputs, size_t functionIndex, size_t tempCounter, size_t spillCounter) 
-        : spillInputs(spillInputs), functionIndex(functionIndex), tempCounter(tempCounter), spillCounter(spillCounter) {
-            for (const auto& v : spillInputs) {
-                varOffsets[v] = spillCounter * 8; 
-                spillCounter++; 
+    SpillBehavior::SpillBehavior(Arena &arena, const std::unordered_set<Symbol> &spillInputs, const std::unordered_map<Symbol, Item*> &constants, const std::unordered_map<Symbol, int64_t> &splitSlots, const std::unordered_set<const Instruction*> &crowded, const LoopPromotions &promotions, std::unordered_set<Symbol> &spillTemps, std::unordered_set<const Item*> &slotItems, const std::unordered_map<Symbol, size_t> &functionVariables, size_t functionIndex, size_t tempCounter, size_t spillCounter) 
+        : spillCounter(spillCounter), tempCounter(tempCounter), spillInputs(spillInputs), constants(constants), crowded(crowded), promotions(promotions), spillTemps(spillTemps), slotItems(slotItems), functionVariables(functionVariables), functionIndex(functionIndex), arena(&arena) {
+            for (Symbol v : spillInputs) {
+                if (constants.count(v)) { continue; } 
+                // split variables already have a slot
+                auto it = splitSlots.find(v); 
+                if (it != splitSlots.end()) {
+                    varOffsets[v] = it->second; 
+                    continue; 
+                }
+                varOffsets[v] = this->spillCounter * 8; 
+                this->spillCounter++; 
             }
             return;
         }
@@ -16,38 +24,51 @@ namespace L2 {
 
     void SpillBehavior::act(Function& f) {
         for (const auto& i: f.instructions) {
+            // temporaries of a crowded instruction die with it
+            bool isCrowded = crowded.count(i); 
+            if (isCrowded) { flush(); } 
+            auto promotion = promotions.find(i); 
+            promotedHere = promotion != promotions.end() ? &promotion->second : nullptr; 
             i->accept(*this);
+            if (isCrowded) { flush(); } 
         }
+        flush(); 
         f.instructions = newInstructions;
     }
 
     void SpillBehavior::act(Instruction_assignment& i) {
         Item* dst = i.dst(); 
         Item* src = i.src(); 
+        if (!touches(dst) && !touches(src)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
+        // the stores and reloads of a split variable, now that it lives in that slot anyway
+        if (isOwnSlot(dst, src) || isOwnSlot(src, dst)) {
+            Item* var = isOwnSlot(dst, src) ? src : dst; 
+            write_back(static_cast<const Variable*>(var)->symbol(), false); 
+            return; 
+        }
         if (dst->kind() == ItemType::MemoryItem) {
-            auto *m = dynamic_cast<Memory*>(dst);
-            Item* temp1 = read(m->getVar());
-            Item* temp2 = read(src);
-
-            Number* num = m->getOffset();
-            auto mem = new Memory(temp1, num);
+            Item* mem = read(dst);
+            Item* temp = read(src);
 
-            auto ni = new Instruction_assignment(mem, temp2);
+            auto ni = arena->make<Instruction_assignment>(mem, temp);
             newInstructions.push_back(ni); 
         } else if (src->kind() == ItemType::MemoryItem) {
-            auto *m = dynamic_cast<Memory*>(src);
-            Item* temp1 = read(m->getVar());
+            Item* mem = read(src); 
 
-            Number* num = m->getOffset();
-            auto mem = new Memory(temp1, num); 
+            Item* temp = defTarget(dst);
 
-            auto temp2 = newTemp();
-
-            auto ni = new Instruction_assignment(temp2, mem); 
+            auto ni = arena->make<Instruction_assignment>(temp, mem); 
 
             newInstructions.push_back(ni); 
 
-            write(dst, temp2); 
+            write(dst, temp); 
+        } else if (!isSpilled(dst) && isSpilled(src) && promoted(src) == nullptr && cacheEntry(static_cast<const Variable*>(src)->symbol()) == cache.end()) {
+            // a copy out of a slot loads straight into its destination
+            auto ni = arena->make<Instruction_assignment>(dst, valueOf(static_cast<const Variable*>(src)->symbol())); 
+            newInstructions.push_back(ni); 
         } else {
             Item* temp = read(src);
             write(dst, temp);
@@ -56,26 +77,29 @@ namespace L2 {
 
     void SpillBehavior::act(Instruction_stack_arg_assignment &i) {
         Item* dst = i.dst(); 
-        Item* src = i.src(); 
-        if (dst->kind() == ItemType::VariableItem && spillInputs.count(dst->emit())) {
-            auto temp = newTemp(); 
-            auto ni = new Instruction_assignment(temp, src); 
-            newInstructions.push_back(ni);
-            write(dst, temp);  
-        } else {
-            auto ni = new Instruction_assignment(dst, src); 
-            newInstructions.push_back(ni); 
+        StackArg* src = i.src(); 
+        if (!isSpilled(dst)) {
+            newInstructions.push_back(&i); 
+            return; 
         }
+        auto temp = defTarget(dst); 
+        auto ni = arena->make<Instruction_stack_arg_assignment>(temp, src); 
+        newInstructions.push_back(ni);
+        write(dst, temp);  
     }
 
     void SpillBehavior::act(Instruction_aop &i) { 
         Item* dst = i.dst(); 
         Item* rhs = i.rhs(); 
         AOP aop = i.aop(); 
+        if (!touches(dst) && !touches(rhs)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
 
         Item* dstTemp = read(dst); 
         Item* rhsTemp = read(rhs); 
-        auto ni = new Instruction_aop(dstTemp, aop, rhsTemp);
+        auto ni = arena->make<Instruction_aop>(dstTemp, aop, rhsTemp);
         newInstructions.push_back(ni); 
 
         write(dst, dstTemp); 
@@ -86,23 +110,35 @@ namespace L2 {
         Item* dst = i.dst(); 
         Item* src = i.src(); 
         SOP sop = i.sop(); 
+        // a variable shift count needs rcx, which nothing cached may hold across the shift
+        bool variableCount = src->kind() == ItemType::VariableItem; 
+        if (variableCount) { flush(); } 
+        if (!touches(dst) && !touches(src)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
 
         Item* dstTemp = read(dst); 
-        Item* srcTemp = read(src); 
-        auto ni = new Instruction_sop(dstTemp, sop, srcTemp);
+        Item* srcTemp = read(src, false); 
+        auto ni = arena->make<Instruction_sop>(dstTemp, sop, srcTemp);
         newInstructions.push_back(ni); 
 
         write(dst, dstTemp); 
+        if (variableCount) { flush(); } 
     }
 
     void SpillBehavior::act(Instruction_mem_aop &i) {
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
         AOP aop = i.aop(); 
+        if (!touches(lhs) && !touches(rhs)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
         Item* lhsTemp = read(lhs);
         Item* rhsTemp = read(rhs);
 
-        auto ni = new Instruction_mem_aop(lhsTemp, aop, rhsTemp); 
+        auto ni = arena->make<Instruction_mem_aop>(lhsTemp, aop, rhsTemp); 
         newInstructions.push_back(ni);
         if (rhs->kind() == ItemType::MemoryItem) {
             write(lhs, lhsTemp);
@@ -114,13 +150,17 @@ namespace L2 {
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
         CMP cmp = i.cmp(); 
+        if (!touches(dst) && !touches(lhs) && !touches(rhs)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
 
         Item* lhsTemp = read(lhs); 
         Item* rhsTemp = read(rhs); 
 
-        auto dstTemp = newTemp(); 
+        Item* dstTemp = defTarget(dst); 
 
-        auto ni = new Instruction_cmp_assignment(dstTemp, lhsTemp, cmp, rhsTemp);
+        auto ni = arena->make<Instruction_cmp_assignment>(dstTemp, lhsTemp, cmp, rhsTemp);
         newInstructions.push_back(ni); 
         write(dst, dstTemp);
     }
@@ -130,50 +170,60 @@ namespace L2 {
         Item* rhs = i.rhs(); 
         Label* label = i.label(); 
         CMP cmp = i.cmp(); 
+        if (!touches(lhs) && !touches(rhs)) {
+            flush(); 
+            newInstructions.push_back(&i); 
+            return; 
+        }
 
         Item* lhsTemp = read(lhs); 
         Item* rhsTemp = read(rhs); 
+        flush(); 
 
-        auto ni = new Instruction_cjump(lhsTemp, cmp, rhsTemp, label); 
+        auto ni = arena->make<Instruction_cjump>(lhsTemp, cmp, rhsTemp, label); 
         newInstructions.push_back(ni); 
     }
 
     void SpillBehavior::act(Instruction_label &i) {
-        Label* label = i.label(); 
-        auto ni = new Instruction_label(label);
-        newInstructions.push_back(ni); 
+        flush(); 
+        newInstructions.push_back(&i); 
     }
 
     void SpillBehavior::act(Instruction_goto &i) {
-        Label* label = i.label(); 
-        auto ni = new Instruction_goto(label);
-        newInstructions.push_back(ni);  
+        flush(); 
+        newInstructions.push_back(&i);  
     }
     
     void SpillBehavior::act(Instruction_ret &i) {
-        auto ni = new Instruction_ret(); 
-        newInstructions.push_back(ni); 
+        // the frame goes away, so pending stores are dead
+        flush(false); 
+        newInstructions.push_back(&i); 
     }
 
     void SpillBehavior::act(Instruction_call &i) {
         Item* callee = i.callee();
         Number* numArgs = i.nArgs();
-        CallType ct = i.callType(); 
-        if (ct == CallType::l1) { 
+        // temporaries would have to survive the call in callee-saved registers, so the cache starts over
+        if (i.callType() == CallType::l1 && touches(callee)) { 
             Item* calleeTemp = read(callee); 
-            auto ni = new Instruction_call(CallType::l1, calleeTemp, numArgs); 
+            flush(); 
+            auto ni = arena->make<Instruction_call>(CallType::l1, calleeTemp, numArgs); 
             newInstructions.push_back(ni); 
         } else {
-            auto ni = new Instruction_call(ct, callee, numArgs); 
-            newInstructions.push_back(ni);
+            flush(); 
+            newInstructions.push_back(&i);
         }
     }
 
     void SpillBehavior::act(Instruction_reg_inc_dec &i) { 
         Item* dst = i.dst(); 
         IncDec op = i.op(); 
+        if (!touches(dst)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
         auto dstTemp = read(dst); 
-        auto ni = new Instruction_reg_inc_dec(dstTemp, op); 
+        auto ni = arena->make<Instruction_reg_inc_dec>(dstTemp, op); 
         newInstructions.push_back(ni);
         write(dst, dstTemp);
     }
@@ -183,45 +233,126 @@ namespace L2 {
         Item* lhs = i.lhs(); 
         Item* rhs = i.rhs(); 
         Number* scale = i.scale();
+        if (!touches(dst) && !touches(lhs) && !touches(rhs)) {
+            newInstructions.push_back(&i); 
+            return; 
+        }
 
         auto lhsTemp = read(lhs); 
         auto rhsTemp = read(rhs); 
 
-        auto dstTemp = newTemp(); 
-        auto ni = new Instruction_lea(dstTemp, lhsTemp, rhsTemp, scale); 
+        Item* dstTemp = defTarget(dst); 
+        auto ni = arena->make<Instruction_lea>(dstTemp, lhsTemp, rhsTemp, scale); 
         newInstructions.push_back(ni); 
 
         write(dst, dstTemp);
     }
 
     Item* SpillBehavior::newTemp() {
-        std::ostringstream temp; 
-        temp << "%S" << tempCounter; 
-        tempCounter++; 
-        std::string tempString = temp.str(); 
-        Item* var = new Variable(tempString);
+        Symbol s; 
+        do {
+            // skip names the function already uses
+            std::ostringstream temp; 
+            temp << "%S" << tempCounter; 
+            tempCounter++; 
+            s = intern(temp.str()); 
+        } while (functionVariables.count(s)); 
+        spillTemps.insert(s); 
+        Item* var = arena->make<Variable>(s);
+        newTemps.insert(var); 
         return var; 
     }
 
-    Item* SpillBehavior::read(Item* src) {
+    // The variable standing in for a spilled one in the loop being rewritten
+    Item* SpillBehavior::promoted(const Item* var) {
+        if (promotedHere == nullptr || var->kind() != ItemType::VariableItem) {
+            return nullptr; 
+        }
+        Symbol v = static_cast<const Variable*>(var)->symbol(); 
+        for (auto& [spilled, local] : *promotedHere) {
+            if (spilled == v) {
+                return local; 
+            }
+        }
+        return nullptr; 
+    }
+
+    // Where an instruction defining dst puts the value
+    Item* SpillBehavior::defTarget(Item* dst) {
+        if (!isSpilled(dst)) {
+            return dst; 
+        }
+        Item* local = promoted(dst); 
+        return local != nullptr ? local : newTemp(); 
+    }
+
+    // What a reload of v reads: its constant or its slot
+    Item* SpillBehavior::valueOf(Symbol v) {
+        auto it = constants.find(v); 
+        if (it != constants.end()) {
+            return it->second; 
+        }
+        return slotOf(v); 
+    }
+
+    Item* SpillBehavior::slotOf(Symbol v) {
+        auto mem = arena->make<Memory>(canonical_register(RegisterID::rsp), make_number(*arena, varOffsets[v])); 
+        slotItems.insert(mem); 
+        return mem; 
+    }
+
+    bool SpillBehavior::isSpilled(const Item* var) {
+        return var->kind() == ItemType::VariableItem && spillInputs.count(static_cast<const Variable*>(var)->symbol()); 
+    }
+
+    // True if the item is a spilled variable or a memory access through one
+    bool SpillBehavior::touches(const Item* item) {
+        if (item->kind() == ItemType::MemoryItem) {
+            return isSpilled(static_cast<const Memory*>(item)->getVar()); 
+        }
+        return isSpilled(item); 
+    }
+
+    bool SpillBehavior::isOwnSlot(const Item* mem, const Item* var) {
+        if (mem->kind() != ItemType::MemoryItem || !isSpilled(var)) {
+            return false; 
+        }
+        auto* m = static_cast<const Memory*>(mem); 
+        auto it = varOffsets.find(static_cast<const Variable*>(var)->symbol()); 
+        return m->getVar()->kind() == ItemType::RegisterItem && static_cast<const Register*>(m->getVar())->id() == RegisterID::rsp 
+            && it != varOffsets.end() && m->getOffset()->value() == static_cast<int64_t>(it->second); 
+    }
+
+    // Uncached reads get a temporary nothing else uses
+    Item* SpillBehavior::read(Item* src, bool cached) {
         Item* var; 
-        if (src->kind() == ItemType::MemoryItem) {
-            auto* m = dynamic_cast<const Memory*>(src); 
+        if (src->kind() == ItemType::MemoryItem && touches(src)) {
+            auto* m = static_cast<const Memory*>(src); 
             Item* temp = read(m->getVar());
-            var = new Memory(temp, m->getOffset()); 
-        } else if (src->kind() == ItemType::VariableItem && spillInputs.count(src->emit())) {
-            std::string v = src->emit(); 
+            var = arena->make<Memory>(temp, m->getOffset()); 
+        } else if (promoted(src) != nullptr) {
+            var = promoted(src); 
+        } else if (isSpilled(src)) {
+            Symbol v = static_cast<const Variable*>(src)->symbol(); 
+            auto entry = cacheEntry(v); 
+            if (entry != cache.end() && cached) {
+                return entry->temp; 
+            }
 
             var = newTemp();
 
-            auto reg = new Register(RegisterID::rsp); 
-            auto num = new Number(varOffsets[v]);
-            auto mem = new Memory(reg, num); 
+            Item* value = entry != cache.end() ? entry->temp : valueOf(v); 
 
-            auto i = new Instruction_assignment(var, mem);
+            auto i = arena->make<Instruction_assignment>(var, value);
 
             newInstructions.push_back(i);
 
+            if (cached) {
+                if (cache.size() == cacheSize) {
+                    write_back(cache.front().var, true); 
+                }
+                cache.push_back({v, var, false}); 
+            }
         } else {
             var = src; 
         }
@@ -230,23 +361,74 @@ namespace L2 {
 
     void SpillBehavior::write(Item* dst, Item* toWrite) {
         Instruction* i; 
-        if (dst->kind() == ItemType::VariableItem && spillInputs.count(dst->emit())) {
-            std::string v = dst->emit(); 
-
-            auto reg = new Register(RegisterID::rsp); 
-            auto num = new Number(varOffsets[v]); 
-            auto mem = new Memory(reg, num); 
-
-            i = new Instruction_assignment(mem, toWrite);
+        if (promoted(dst) != nullptr) {
+            if (promoted(dst) == toWrite) { return; } 
+            i = arena->make<Instruction_assignment>(promoted(dst), toWrite); 
+        } else if (isSpilled(dst)) {
+            Symbol v = static_cast<const Variable*>(dst)->symbol(); 
+            // the only def of a constant; uses recreate the value
+            if (constants.count(v)) { return; } 
+
+            // whatever was pending for v is dead now
+            auto entry = cacheEntry(v); 
+            if (entry != cache.end()) {
+                cache.erase(entry); 
+            }
+            // only a temporary of this rewrite that no other variable holds can stand in for v
+            bool shared = std::any_of(cache.begin(), cache.end(), [&](const CachedValue& c) { return c.temp == toWrite; }); 
+            if (!newTemps.count(toWrite) || shared) {
+                store(v, toWrite); 
+                return; 
+            }
+            if (cache.size() == cacheSize) {
+                write_back(cache.front().var, true); 
+            }
+            cache.push_back({v, toWrite, true}); 
+            return; 
+        } else if (dst != toWrite) {
+            i = arena->make<Instruction_assignment>(dst, toWrite); 
         } else {
-            i = new Instruction_assignment(dst, toWrite); 
+            return; 
         }
         newInstructions.push_back(i); 
     }
 
-    std::tuple<size_t, size_t> spill(Program& p, const std::unordered_set<std::string> &spillInputs, size_t functionIndex, size_t tempCounter, size_t spillCounter) {
-        SpillBehavior sb(spillInputs, functionIndex, tempCounter, spillCounter); 
+    std::vector<SpillBehavior::CachedValue>::iterator SpillBehavior::cacheEntry(Symbol v) {
+        return std::find_if(cache.begin(), cache.end(), [&](const CachedValue& c) { return c.var == v; }); 
+    }
+
+    void SpillBehavior::store(Symbol v, Item* temp) {
+        newInstructions.push_back(arena->make<Instruction_assignment>(slotOf(v), temp)); 
+    }
+
+    void SpillBehavior::write_back(Symbol v, bool forget) {
+        auto entry = cacheEntry(v); 
+        if (entry == cache.end()) {
+            return; 
+        }
+        if (entry->dirty) {
+            store(v, entry->temp); 
+            entry->dirty = false; 
+        }
+        if (forget) {
+            cache.erase(entry); 
+        }
+    }
+
+    void SpillBehavior::flush(bool storeDirty) {
+        for (auto& c : cache) {
+            if (c.dirty && storeDirty) {
+                store(c.var, c.temp); 
+            }
+        }
+        cache.clear(); 
+    }
+
+    std::tuple<size_t, size_t> spill(Program& p, Arena &arena, const std::unordered_set<Symbol> &spillInputs, const std::unordered_map<Symbol, Item*> &constants, const std::unordered_map<Symbol, int64_t> &splitSlots, const std::unordered_set<const Instruction*> &crowded, const LoopPromotions &promotions, std::unordered_set<Symbol> &spillTemps, std::unordered_set<const Item*> &slotItems, const std::unordered_map<Symbol, size_t> &functionVariables, size_t functionIndex, size_t tempCounter, size_t spillCounter) {
+        SpillBehavior sb(arena, spillInputs, constants, splitSlots, crowded, promotions, spillTemps, slotItems, functionVariables, functionIndex, tempCounter, spillCounter); 
         p.accept(sb); 
+        L2_TRACE(TraceSpill, "spill " << p.functions[functionIndex]->name << ": " << spillInputs.size() << " variables (" << constants.size() << " rematerialized), " 
+            << sb.spillCounter << " slots, " << p.functions[functionIndex]->instructions.size() << " instructions"); 
         return {sb.tempCounter, sb.spillCounter}; 
     }
-}
\ No newline at end of file
+}
@@ -7,16 +7,19 @@
 #include <vector> 
 #include <sstream> 
 #include <tuple> 
-#include <liveness_analysis.h>
+#include <utility> 
+#include <behavior.h>
 #include <L2.h>
 
 
 namespace L2{
 
+    // For each instruction of a loop, the spilled variables it mentions that have a register of their own there
+    using LoopPromotions = std::unordered_map<const Instruction*, std::vector<std::pair<Symbol, Item*>>>; 
 
     class SpillBehavior: public Behavior {
         public: 
-            explicit SpillBehavior(const std::unordered_set<std::string> &spillInputs, size_t functionIndex, size_t tempCounter, size_t spillCounter); 
+            explicit SpillBehavior(Arena &arena, const std::unordered_set<Symbol> &spillInputs, const std::unordered_map<Symbol, Item*> &constants, const std::unordered_map<Symbol, int64_t> &splitSlots, const std::unordered_set<const Instruction*> &crowded, const LoopPromotions &promotions, std::unordered_set<Symbol> &spillTemps, std::unordered_set<const Item*> &slotItems, const std::unordered_map<Symbol, size_t> &functionVariables, size_t functionIndex, size_t tempCounter, size_t spillCounter); 
             void act(Program& p) override; 
             void act(Function &f) override; 
             virtual void act(Instruction_assignment &i) override; 
@@ -34,18 +37,58 @@ namespace L2{
             virtual void act(Instruction_lea &i) override; 
 
             Item* newTemp();
-            Item* read(Item* src);
+            Item* promoted(const Item* var); 
+            Item* defTarget(Item* dst); 
+            Item* valueOf(Symbol v); 
+            Item* read(Item* src, bool cached = true);
             void write(Item* dst, Item* toWrite); 
+            void store(Symbol v, Item* temp); 
+            void write_back(Symbol v, bool forget); 
+            void flush(bool storeDirty = true); 
+            bool isSpilled(const Item* var); 
+            bool touches(const Item* item); 
+            bool isOwnSlot(const Item* mem, const Item* var); 
+            Item* slotOf(Symbol v); 
 
             size_t spillCounter; 
             size_t tempCounter; 
         private:  
-            std::unordered_set<std::string> spillInputs; 
-            std::unordered_map<std::string, size_t> varOffsets; 
+            std::unordered_set<Symbol> spillInputs; 
+            // Spilled variables that always hold this value; they get no slot and are rematerialized
+            const std::unordered_map<Symbol, Item*> &constants; 
+            // Instructions around which nothing stays cached, see crowded_instructions()
+            const std::unordered_set<const Instruction*> &crowded; 
+            const LoopPromotions &promotions; 
+            // Promotions of the instruction being rewritten, if it has any
+            const std::vector<std::pair<Symbol, Item*>>* promotedHere = nullptr; 
+            std::unordered_set<Symbol> &spillTemps; 
+            // Every slot access made here goes in, so stack slot coloring can tell it from the program's own
+            std::unordered_set<const Item*> &slotItems; 
+            // Names the function already uses, so temporaries do not collide with them
+            const std::unordered_map<Symbol, size_t> &functionVariables; 
+            std::unordered_map<Symbol, size_t> varOffsets; 
             size_t functionIndex; 
+            Arena* arena; 
             
             std::vector<Instruction*> newInstructions;
+
+            /*
+             * Spilled variables whose value sits in a temporary of this block, oldest
+             * first. Dirty ones still owe their slot a store, which is made when the
+             * block ends, before a call, around crowded instructions and variable
+             * shifts, or when the entry is evicted; a later def makes it dead instead.
+             * Temporaries can't be spilled, so only a few stay cached at a time.
+             */
+            struct CachedValue {
+                Symbol var; 
+                Item* temp; 
+                bool dirty; 
+            };
+            static constexpr size_t cacheSize = 4; 
+            std::vector<CachedValue> cache; 
+            std::vector<CachedValue>::iterator cacheEntry(Symbol v); 
+            std::unordered_set<const Item*> newTemps; 
     };
 
-    std::tuple<size_t, size_t> spill(Program &p, const std::unordered_set<std::string> &spillInputs, size_t functionIndex, size_t tempCounter, size_t spillCounter); 
+    std::tuple<size_t, size_t> spill(Program &p, Arena &arena, const std::unordered_set<Symbol> &spillInputs, const std::unordered_map<Symbol, Item*> &constants, const std::unordered_map<Symbol, int64_t> &splitSlots, const std::unordered_set<const Instruction*> &crowded, const LoopPromotions &promotions, std::unordered_set<Symbol> &spillTemps, std::unordered_set<const Item*> &slotItems, const std::unordered_map<Symbol, size_t> &functionVariables, size_t functionIndex, size_t tempCounter, size_t spillCounter); 
 }
\ No newline at end of file
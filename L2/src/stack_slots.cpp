@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include <stack_slots.h>
+#include <interference_graph.h>
+#include <trace.h>
+
+namespace L2 {
+
+  StackSlotBehavior::StackSlotBehavior(Arena &arena, size_t slots, const std::unordered_set<const Item*> &slotItems)
+    : arena(&arena), slots(slots), slotItems(&slotItems) {}
+
+  void StackSlotBehavior::act(Program &p) {
+    for (Function* f: p.functions) {
+      f->accept(*this);
+    }
+  }
+
+  void StackSlotBehavior::act(Function &f) {
+    uses.clear();
+    defs.clear();
+    reserved.assign(slots, false);
+    for (Instruction*& i: f.instructions) {
+      uses.emplace_back(slots);
+      defs.emplace_back(slots);
+      current = i;
+      i->accept(*this);
+      i = current;
+    }
+  }
+
+  void StackSlotBehavior::renumber(Function &f, const std::vector<size_t> &newSlots) {
+    renumbered = &newSlots;
+    f.accept(*this);
+    renumbered = nullptr;
+  }
+
+  long StackSlotBehavior::slot(const Item* item) const {
+    if (!slotItems->count(item)) {
+      return -1;
+    }
+    int64_t offset = static_cast<const Memory*>(item)->getOffset()->value();
+    if (offset < 0 || offset % 8 != 0 || offset / 8 >= static_cast<int64_t>(slots)) {
+      return -1;
+    }
+    return offset / 8;
+  }
+
+  void StackSlotBehavior::reserve(const Item* item) {
+    if (item->kind() != ItemType::MemoryItem || slotItems->count(item)) {
+      return;
+    }
+    auto* m = static_cast<const Memory*>(item);
+    if (m->getVar()->kind() != ItemType::RegisterItem || static_cast<const Register*>(m->getVar())->id() != RegisterID::rsp) {
+      return;
+    }
+    // every word the 8 bytes at offset overlap
+    int64_t offset = m->getOffset()->value();
+    for (int64_t w = std::max<int64_t>(offset, 0) / 8; w * 8 < offset + 8 && w < static_cast<int64_t>(slots); w++) {
+      reserved[w] = true;
+    }
+  }
+
+  Item* StackSlotBehavior::moved(Item* item) {
+    long k = slot(item);
+    if (k < 0 || (*renumbered)[k] == static_cast<size_t>(k)) {
+      return item;
+    }
+    return arena->make<Memory>(canonical_register(RegisterID::rsp), make_number(*arena, (*renumbered)[k] * 8));
+  }
+
+  void StackSlotBehavior::act(Instruction_assignment &i) {
+    reserve(i.dst());
+    reserve(i.src());
+    long dst = slot(i.dst());
+    long src = slot(i.src());
+    if (dst >= 0) {
+      defs.back().set(dst);
+    }
+    if (src >= 0) {
+      uses.back().set(src);
+    }
+    if (renumbered != nullptr && (dst >= 0 || src >= 0)) {
+      current = arena->make<Instruction_assignment>(moved(i.dst()), moved(i.src()));
+    }
+  }
+
+  void StackSlotBehavior::act(Instruction_mem_aop &i) {
+    reserve(i.lhs());
+    reserve(i.rhs());
+    long lhs = slot(i.lhs());
+    long rhs = slot(i.rhs());
+    if (lhs >= 0) {
+      uses.back().set(lhs);
+      defs.back().set(lhs);
+    }
+    if (rhs >= 0) {
+      uses.back().set(rhs);
+    }
+    if (renumbered != nullptr && (lhs >= 0 || rhs >= 0)) {
+      current = arena->make<Instruction_mem_aop>(moved(i.lhs()), i.aop(), moved(i.rhs()));
+    }
+  }
+
+  void StackSlotBehavior::act(Instruction_stack_arg_assignment &i) {}
+  void StackSlotBehavior::act(Instruction_aop &i) {}
+  void StackSlotBehavior::act(Instruction_sop &i) {}
+  void StackSlotBehavior::act(Instruction_cmp_assignment &i) {}
+  void StackSlotBehavior::act(Instruction_cjump &i) {}
+  void StackSlotBehavior::act(Instruction_label &i) {}
+  void StackSlotBehavior::act(Instruction_goto &i) {}
+  void StackSlotBehavior::act(Instruction_ret &i) {}
+  void StackSlotBehavior::act(Instruction_call &i) {}
+  void StackSlotBehavior::act(Instruction_reg_inc_dec &i) {}
+  void StackSlotBehavior::act(Instruction_lea &i) {}
+
+  /*
+   * Liveness of slots over the CFG, then the usual interference: a store
+   * interferes with every slot live after it, and slots live at the entry all
+   * hold whatever the frame held, so they interfere with each other. Slots are
+   * colored busiest first with the lowest free word the program doesn't use
+   * itself, so the frame only has as many words as slots are ever live together
+   * plus the program's own.
+   */
+  size_t color_stack_slots(Function &f, const CFG &cfg, Arena &arena, size_t slots, const std::unordered_set<const Item*> &slotItems) {
+    if (slots == 0) {
+      return slots;
+    }
+    StackSlotBehavior b(arena, slots, slotItems);
+    f.accept(b);
+
+    size_t n = cfg.blocks.size();
+    std::vector<BitVector> gen(n, BitVector(slots)), kill(n, BitVector(slots));
+    std::vector<BitVector> in(n, BitVector(slots)), out(n, BitVector(slots));
+    for (size_t k = 0; k < n; k++) {
+      for (size_t j = cfg.blocks[k].last + 1; j-- > cfg.blocks[k].first;) {
+        gen[k].assign_gen_out_kill(b.uses[j], gen[k], b.defs[j]);
+        kill[k].union_with(b.defs[j]);
+      }
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t k = n; k-- > 0;) {
+        for (size_t s : cfg.blocks[k].succs) {
+          out[k].union_with(in[s]);
+        }
+        changed |= in[k].assign_gen_out_kill(gen[k], out[k], kill[k]);
+      }
+    }
+
+    InterferenceGraph graph;
+    graph.reset(slots);
+    for (size_t k = 0; k < n; k++) {
+      BitVector live = out[k];
+      for (size_t j = cfg.blocks[k].last + 1; j-- > cfg.blocks[k].first;) {
+        b.defs[j].for_each([&](size_t d) {
+          live.for_each([&](size_t l) { graph.add_edge(d, l); });
+        });
+        live.assign_gen_out_kill(b.uses[j], live, b.defs[j]);
+      }
+    }
+    if (n > 0) {
+      in[0].for_each([&](size_t a) {
+        in[0].for_each([&](size_t c) { graph.add_edge(a, c); });
+      });
+    }
+
+    std::vector<size_t> order(slots);
+    for (size_t k = 0; k < slots; k++) {
+      order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t c) { return graph.degree(a) > graph.degree(c); });
+    const size_t uncolored = std::numeric_limits<size_t>::max();
+    std::vector<size_t> renumbered(slots, uncolored);
+    // the frame keeps covering the words the program accesses itself
+    size_t used = std::find(b.reserved.rbegin(), b.reserved.rend(), true).base() - b.reserved.begin();
+    bool moved = false;
+    for (size_t k : order) {
+      std::vector<bool> taken(used + 1, false);
+      std::copy(b.reserved.begin(), b.reserved.begin() + std::min(used, slots), taken.begin());
+      for (size_t neigh : graph.neighbors(k)) {
+        if (renumbered[neigh] != uncolored) {
+          taken[renumbered[neigh]] = true;
+        }
+      }
+      renumbered[k] = std::find(taken.begin(), taken.end(), false) - taken.begin();
+      used = std::max(used, renumbered[k] + 1);
+      moved |= renumbered[k] != k;
+    }
+    if (moved) {
+      b.renumber(f, renumbered);
+    }
+    L2_TRACE(TraceSpill, "slots " << f.name << ": " << slots << " spill slots in " << used << " words");
+    return used;
+  }
+}
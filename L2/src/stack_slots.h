@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+#include <L2.h>
+#include <behavior.h>
+#include <bit_vector.h>
+#include <cfg.h>
+
+namespace L2 {
+
+  /*
+   * Spill slot k is the word at mem rsp 8k, reached only through the items in
+   * slotItems. Records which slots each instruction loads and stores, and
+   * rewrites the accesses once slots get new numbers. Anything but a plain load
+   * or store of a slot counts as both. The program's own rsp accesses are left
+   * alone; the words they touch are reserved.
+   */
+  class StackSlotBehavior : public Behavior {
+    public:
+      StackSlotBehavior(Arena &arena, size_t slots, const std::unordered_set<const Item*> &slotItems);
+      void act(Program &p) override;
+      void act(Function &f) override;
+      virtual void act(Instruction_assignment &i) override;
+      virtual void act(Instruction_stack_arg_assignment &i) override;
+      virtual void act(Instruction_aop &i) override;
+      virtual void act(Instruction_sop &i) override;
+      virtual void act(Instruction_mem_aop &i) override;
+      virtual void act(Instruction_cmp_assignment &i) override;
+      virtual void act(Instruction_cjump &i) override;
+      virtual void act(Instruction_label &i) override;
+      virtual void act(Instruction_goto &i) override;
+      virtual void act(Instruction_ret &i) override;
+      virtual void act(Instruction_call &i) override;
+      virtual void act(Instruction_reg_inc_dec &i) override;
+      virtual void act(Instruction_lea &i) override;
+
+      // Visits f again, moving slot k to newSlots[k]
+      void renumber(Function &f, const std::vector<size_t> &newSlots);
+
+      // Per instruction
+      std::vector<BitVector> uses;
+      std::vector<BitVector> defs;
+      // Words below slots the program accesses itself
+      std::vector<bool> reserved;
+
+    private:
+      // The slot a memory item accesses, -1 if it is not a slot
+      long slot(const Item* item) const;
+      void reserve(const Item* item);
+      Item* moved(Item* item);
+
+      Arena* arena;
+      size_t slots;
+      const std::unordered_set<const Item*>* slotItems;
+      const std::vector<size_t>* renumbered = nullptr;
+      // The instruction being visited, replaced when it has to be rewritten
+      Instruction* current = nullptr;
+  };
+
+  // Lets slots that are never live at the same time share a word; returns how many words the frame needs
+  size_t color_stack_slots(Function &f, const CFG &cfg, Arena &arena, size_t slots, const std::unordered_set<const Item*> &slotItems);
+}
@@ -0,0 +1,54 @@
+#include <mutex>
+
+#include <symbol.h>
+
+namespace L2 {
+
+  Symbol SymbolTable::intern(std::string_view name) {
+    {
+      std::shared_lock<std::shared_mutex> reading(lock);
+      auto it = ids.find(name);
+      if (it != ids.end()) {
+        return it->second;
+      }
+    }
+    std::unique_lock<std::shared_mutex> writing(lock);
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+      return it->second;
+    }
+    Symbol s = static_cast<Symbol>(names.size());
+    names.emplace_back(name);
+    // keys view the deque's strings, which never move
+    ids.emplace(names.back(), s);
+    return s;
+  }
+
+  bool SymbolTable::contains(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> reading(lock);
+    return ids.count(name) != 0;
+  }
+
+  const std::string& SymbolTable::name(Symbol s) const {
+    std::shared_lock<std::shared_mutex> reading(lock);
+    return names[s];
+  }
+
+  size_t SymbolTable::size() const {
+    std::shared_lock<std::shared_mutex> reading(lock);
+    return names.size();
+  }
+
+  SymbolTable& symbols() {
+    static SymbolTable table;
+    return table;
+  }
+
+  Symbol intern(std::string_view name) {
+    return symbols().intern(name);
+  }
+
+  const std::string& symbol_name(Symbol s) {
+    return symbols().name(s);
+  }
+}
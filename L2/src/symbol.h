@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace L2 {
+
+  // Interned name of a variable, label or function
+  using Symbol = uint32_t;
+
+  /*
+   * Every name is mapped to a small integer once, when it is parsed, so later
+   * passes compare and hash integers instead of strings. Allocation threads
+   * intern spill temporaries, so access is guarded.
+   */
+  class SymbolTable {
+    public:
+      Symbol intern(std::string_view name);
+      bool contains(std::string_view name) const;
+      const std::string& name(Symbol s) const;
+      size_t size() const;
+
+    private:
+      std::deque<std::string> names;
+      std::unordered_map<std::string_view, Symbol> ids;
+      mutable std::shared_mutex lock;
+  };
+
+  SymbolTable& symbols();
+
+  Symbol intern(std::string_view name);
+  const std::string& symbol_name(Symbol s);
+}
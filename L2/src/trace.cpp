@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+
+#include <trace.h>
+
+namespace L2 {
+
+  uint32_t traceMask = 0;
+
+  namespace {
+    // Lines from every thread collect here and are written out 64KB at a time
+    struct TraceBuffer {
+      std::mutex lock;
+      std::string pending;
+
+      ~TraceBuffer() { flush(); }
+
+      void flush() {
+        if (pending.empty()) return;
+        std::fwrite(pending.data(), 1, pending.size(), stderr);
+        std::fflush(stderr);
+        pending.clear();
+      }
+    };
+
+    TraceBuffer& buffer() {
+      static TraceBuffer b;
+      return b;
+    }
+  }
+
+  uint32_t trace_categories(std::string_view list) {
+    uint32_t mask = 0;
+    while (!list.empty()) {
+      size_t comma = list.find(',');
+      std::string_view name = list.substr(0, comma);
+      if (name == "parse") mask |= TraceParse;
+      else if (name == "liveness") mask |= TraceLiveness;
+      else if (name == "spill") mask |= TraceSpill;
+      else if (name == "codegen") mask |= TraceCodegen;
+      else if (name == "all") mask |= TraceAll;
+      else throw std::runtime_error("unknown trace category " + std::string(name));
+      list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    return mask;
+  }
+
+  void trace_write(const std::string& line) {
+    TraceBuffer& b = buffer();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.pending += line;
+    if (b.pending.size() >= 64 * 1024) b.flush();
+  }
+
+  void trace_flush() {
+    TraceBuffer& b = buffer();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.flush();
+  }
+}
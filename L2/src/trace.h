@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace L2 {
+
+  // Diagnostic categories, selected with -t (comma separated) or all at once with -v
+  enum TraceCategory : uint32_t {
+    TraceParse = 1,
+    TraceLiveness = 2,
+    TraceSpill = 4,
+    TraceCodegen = 8,
+    TraceAll = 15
+  };
+
+  // Building with -DL2_NO_TRACE removes every trace point
+#ifdef L2_NO_TRACE
+  inline constexpr bool traceCompiledIn = false;
+#else
+  inline constexpr bool traceCompiledIn = true;
+#endif
+
+  extern uint32_t traceMask;
+
+  inline bool trace_enabled(uint32_t category) {
+    return traceCompiledIn && (traceMask & category) != 0;
+  }
+
+  // Parses "parse,codegen" style lists; throws on an unknown name
+  uint32_t trace_categories(std::string_view list);
+
+  // Appends one line to the trace buffer, which goes to stderr in large chunks
+  void trace_write(const std::string& line);
+  void trace_flush();
+}
+
+// The message is only formatted when its category is on
+#define L2_TRACE(category, message) \
+  do { \
+    if (::L2::trace_enabled(category)) { \
+      std::ostringstream traceLine; \
+      traceLine << message << '\n'; \
+      ::L2::trace_write(traceLine.str()); \
+    } \
+  } while (0)
@@ -0,0 +1,192 @@
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <test.h>
+
+using namespace L2;
+
+// %x is live where rcx holds the shift's 5 and the shift needs rcx for %c, so its spill
+// temporary only meets registers and other temporaries: there is nothing left to spill
+static const char* pinned = R"((@ok
+(@ok
+  0
+  %v <- 1
+  rdi <- %v
+  call print 1
+  return
+)
+(@pinned
+  0
+  %c <- rdi
+  rcx <- 5
+  %x <- 1
+  %x <<= %c
+  rdi <- rcx
+  rdi += %x
+  call print 1
+  return
+)
+)
+)";
+
+static void expect_allocation_error(size_t jobs) {
+  auto p = parse_string(pinned, "pinned");
+  bool thrown = false;
+  try {
+    test::generate(p, jobs);
+  } catch (const std::runtime_error &e) {
+    thrown = true;
+    L2_CHECK(std::string(e.what()).find("@pinned") != std::string::npos);
+  }
+  L2_CHECK(thrown);
+}
+
+// Used to spin forever spilling nothing; now both the serial and the parallel allocator give up
+static void unallocatable_function() {
+  expect_allocation_error(1);
+  expect_allocation_error(2);
+}
+
+// %a and %b don't interfere, so they share rdi with the argument and the copy between them is gone
+static void copies_coalesce() {
+  auto p = parse_string(R"((@f
+(@f
+  1
+  %b <- rdi
+  %b += 2
+  %a <- %b
+  %a *= 3
+  rax <- %a
+  return
+)
+)
+)", "copies_coalesce");
+  const std::string expected =
+    "(@f\n"
+    "  (@f\n"
+    "1 0\n"
+    "  rdi += 2\n"
+    "  rdi *= 3\n"
+    "  rax <- rdi\n"
+    "  return\n"
+    "  ))";
+  L2_CHECK(test::generate(p) == expected);
+}
+
+// The code test::generate wrote, a line per entry
+static std::vector<std::string> lines_of(const std::string &code) {
+  std::istringstream in(code);
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(in, line); ) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// Index of the first line starting with prefix, or lines.size()
+static size_t find_line(const std::vector<std::string> &lines, const std::string &prefix) {
+  for (size_t j = 0; j < lines.size(); j++) {
+    if (lines[j].rfind(prefix, 0) == 0) { return j; }
+  }
+  return lines.size();
+}
+
+// Seven variables are live across the loop and not all of them fit in registers; the ones
+// used only after it spill, and the counter used on every iteration keeps its register.
+// The loop shares its exit with the jump around it, so splitting leaves the variables
+// alone and the spill costs decide. Without the loop weighting the counter spills.
+static void loop_counter_keeps_register() {
+  std::string source = "(@f\n(@f\n  1\n";
+  for (int k = 0; k < 7; k++) {
+    source += "  %c" + std::to_string(k) + " <- rdi\n  %c" + std::to_string(k) + " += " + std::to_string(k) + "\n";
+  }
+  source += "  %i <- rdi\n  rax <- 0\n  cjump %i <= 0 :done\n  :loop\n"
+            "  %t0 <- %i\n  %t0 += 0\n  %t1 <- %i\n  %t1 += 1\n  rax += %t0\n  rax += %t1\n"
+            "  %i -= 1\n  cjump 0 < %i :loop\n  :done\n";
+  for (int round = 0; round < 2; round++) {
+    for (int k = 0; k < 7; k++) {
+      source += "  rax += %c" + std::to_string(k) + "\n";
+    }
+  }
+  source += "  return\n)\n)\n";
+  auto p = parse_string(source, "loop_counter_keeps_register");
+  auto lines = lines_of(test::generate(p));
+
+  size_t label = find_line(lines, "  :loop");
+  size_t cjump = find_line(lines, "  cjump 0 <");
+  L2_CHECK(cjump > label && cjump < lines.size());
+  L2_CHECK(lines.size() > 2 && lines[2] != "1 0");
+  for (size_t j = label + 1; j < cjump && j < lines.size(); j++) {
+    L2_CHECK(lines[j].find("mem rsp") == std::string::npos);
+  }
+}
+
+// The same pressure with variables that only ever hold a constant: they are loaded again
+// where they are used instead of getting a stack slot
+static void constants_rematerialize() {
+  std::string source = "(@f\n(@f\n  1\n";
+  for (int k = 0; k < 10; k++) {
+    source += "  %c" + std::to_string(k) + " <- " + std::to_string(100 + k) + "\n";
+  }
+  source += "  %i <- rdi\n  :loop\n  %i -= 1\n  cjump 0 < %i :loop\n  rax <- 0\n";
+  for (int k = 0; k < 10; k++) {
+    source += "  rax += %c" + std::to_string(k) + "\n";
+  }
+  source += "  return\n)\n)\n";
+  auto p = parse_string(source, "constants_rematerialize");
+  auto lines = lines_of(test::generate(p));
+
+  L2_CHECK(lines.size() > 2 && lines[2] == "1 0");
+  L2_CHECK(find_line(lines, "  :loop") < lines.size());
+  size_t reloads = 0;
+  for (size_t j = find_line(lines, "  :loop"); j < lines.size(); j++) {
+    L2_CHECK(lines[j].find("mem rsp") == std::string::npos);
+    reloads += lines[j].find(" <- 10") != std::string::npos;
+  }
+  L2_CHECK(reloads > 0);
+}
+
+// %v is live through a loop that never mentions it and has nothing to spare: it is stored
+// on the way in and reloaded on the way out, and keeps a register before and after the loop
+static void split_around_loop() {
+  std::string source = "(@f\n(@f\n  1\n  %v <- rdi\n  %v += 1\n  %i <- 10\n  rax <- 0\n  :loop\n";
+  for (int k = 0; k < 10; k++) {
+    source += "  %t" + std::to_string(k) + " <- %i\n  %t" + std::to_string(k) + " += " + std::to_string(k) + "\n";
+  }
+  for (int k = 0; k < 10; k++) {
+    source += "  rax += %t" + std::to_string(k) + "\n";
+  }
+  source += "  %i -= 1\n  cjump 0 < %i :loop\n  rax += %v\n  return\n)\n)\n";
+  auto p = parse_string(source, "split_around_loop");
+  auto lines = lines_of(test::generate(p));
+
+  size_t label = find_line(lines, "  :loop");
+  size_t cjump = find_line(lines, "  cjump");
+  L2_CHECK(label > 3 && cjump + 1 < lines.size());
+  if (label <= 3 || cjump + 1 >= lines.size()) { return; }
+
+  // mem rsp N <- r ahead of the loop and r <- mem rsp N after it
+  const std::string& store = lines[label - 1];
+  size_t arrow = store.find(" <- ");
+  L2_CHECK(store.rfind("  mem rsp ", 0) == 0 && arrow != std::string::npos);
+  if (arrow == std::string::npos) { return; }
+  std::string slot = store.substr(2, arrow - 2);
+  std::string reg = store.substr(arrow + 4);
+  L2_CHECK(lines[cjump + 1] == "  " + reg + " <- " + slot);
+  for (size_t j = 3; j < label - 1; j++) {
+    L2_CHECK(lines[j].find("mem rsp") == std::string::npos);
+  }
+  for (size_t j = label + 1; j < cjump; j++) {
+    L2_CHECK((lines[j] + " ").find(slot + " ") == std::string::npos);
+  }
+}
+
+int main() {
+  unallocatable_function();
+  copies_coalesce();
+  loop_counter_keeps_register();
+  constants_rematerialize();
+  split_around_loop();
+  return test::failures;
+}
@@ -0,0 +1,97 @@
+#include <regex>
+
+#include <test.h>
+
+using namespace L2;
+
+// Programs that only use registers come out of -g as they went in, apart from stack-arg
+static void registers_only() {
+  auto p = parse_string(R"((@main
+(@main
+0
+  rdi <- 5
+  rsi <- 7
+  rax <- rdi < rsi
+  rdx @ rdi rsi 4
+  cjump rdi <= rsi :done
+  call tuple-error 3
+  :done
+  rdi <- rax
+  call print 1
+  return
+)
+(@f
+8
+  rax <- stack-arg 0
+  rdi <- stack-arg 8
+  rax += rdi
+  return
+)
+)
+)", "registers_only");
+  const std::string expected =
+    "(@main\n"
+    "  (@main\n"
+    "0 0\n"
+    "  rdi <- 5\n"
+    "  rsi <- 7\n"
+    "  rax <- rdi < rsi\n"
+    "  rdx @ rdi rsi 4\n"
+    "  cjump rdi <= rsi :done\n"
+    "  call tuple-error 3\n"
+    "  :done\n"
+    "  rdi <- rax\n"
+    "  call print 1\n"
+    "  return\n"
+    "  )"
+    "  (@f\n"
+    "8 0\n"
+    "  rax <- mem rsp 0\n"
+    "  rdi <- mem rsp 8\n"
+    "  rax += rdi\n"
+    "  return\n"
+    "  ))";
+  L2_CHECK(test::generate(p) == expected);
+}
+
+// Twelve values live across a call can't all have a register, so some get spill slots
+// below the stack arguments, which move up by the locals the function ended up with
+static void spills_below_stack_args() {
+  std::string source = "(@f\n(@f\n8\n  %arg <- stack-arg 8\n";
+  for (int k = 0; k < 12; k++) {
+    source += "  %v" + std::to_string(k) + " <- rdi\n  %v" + std::to_string(k) + " += " + std::to_string(k) + "\n";
+  }
+  source += "  rdi <- 1\n  call print 1\n  rax <- %arg\n";
+  for (int k = 0; k < 12; k++) {
+    source += "  rax += %v" + std::to_string(k) + "\n";
+  }
+  source += "  return\n)\n)\n";
+  auto p = parse_string(source, "spills_below_stack_args");
+  std::string code = test::generate(p);
+
+  std::smatch header;
+  L2_CHECK(std::regex_search(code, header, std::regex("\\(@f\\n8 (\\d+)\\n")));
+  long locals = header.empty() ? 0 : std::stol(header[1]);
+  L2_CHECK(locals > 0);
+  L2_CHECK(code.find('%') == std::string::npos);
+  L2_CHECK(code.find("stack-arg") == std::string::npos);
+
+  // the one stack argument is read right above the locals; everything else is a slot
+  const std::regex slot("mem rsp (\\d+)");
+  bool argumentRead = false;
+  for (auto it = std::sregex_iterator(code.begin(), code.end(), slot); it != std::sregex_iterator(); it++) {
+    long offset = std::stol((*it)[1]);
+    if (offset == locals * 8 + 8) {
+      argumentRead = true;
+    } else {
+      L2_CHECK(offset % 8 == 0 && offset < locals * 8);
+    }
+  }
+  L2_CHECK(argumentRead);
+}
+
+int main() {
+  registers_only();
+  spills_below_stack_args();
+  return test::failures;
+}
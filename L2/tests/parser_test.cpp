@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include <test.h>
+
+using namespace L2;
+
+static const char* wholeProgram = R"((@main
+  (@main
+    0
+    rdi <- 5
+    call @f 1
+    return
+  )
+  (@f
+    1
+    %x <- rdi
+    rax <- %x
+    return
+  )
+)
+)";
+
+static const char* loneFunctions = R"(// functions without the program around them
+(@f
+  1
+  %x <- rdi
+  rax <- %x
+  return
+)
+
+(@g
+  0
+  return
+)
+)";
+
+static std::string names(const Program &p) {
+  std::string result;
+  for (const Function* f : p.functions) {
+    result += f->name + "/" + std::to_string(f->arguments) + "/" + std::to_string(f->instructions.size()) + " ";
+  }
+  return result;
+}
+
+// parse_file maps the file instead of reading a string; both have to agree
+static Program parse_through_file(const std::string &source) {
+  char path[] = "/tmp/l2_parser_test_XXXXXX";
+  int fd = mkstemp(path);
+  L2_CHECK(fd >= 0);
+  close(fd);
+  std::ofstream(path) << source;
+  Program p = parse_file(path);
+  std::remove(path);
+  return p;
+}
+
+static void whole_program() {
+  auto p = parse_string(wholeProgram, "whole_program");
+  L2_CHECK(p.entryPointLabel == "@main");
+  L2_CHECK(names(p) == "@main/0/3 @f/1/3 ");
+
+  auto fromFile = parse_through_file(wholeProgram);
+  L2_CHECK(fromFile.entryPointLabel == "@main");
+  L2_CHECK(names(fromFile) == names(p));
+}
+
+// A file with only functions, as function tests give them, gets @go as its entry point
+static void lone_functions() {
+  auto p = parse_string(loneFunctions, "lone_functions");
+  L2_CHECK(p.entryPointLabel == "@go");
+  L2_CHECK(names(p) == "@f/1/3 @g/0/1 ");
+
+  auto fromFile = parse_through_file(loneFunctions);
+  L2_CHECK(fromFile.entryPointLabel == "@go");
+  L2_CHECK(names(fromFile) == names(p));
+}
+
+// Parsing from memory behaves like a file, including where errors are reported
+static void parse_string_errors() {
+  bool thrown = false;
+  try {
+    parse_string("(@f\n  1\n  %x <-\n)\n", "broken.L2");
+  } catch (const std::runtime_error &e) {
+    thrown = true;
+    L2_CHECK(std::string(e.what()).find("broken.L2:3:") != std::string::npos);
+  }
+  L2_CHECK(thrown);
+
+  // a failed parse leaves nothing behind for the next one
+  auto p = parse_string(loneFunctions, "after_error");
+  L2_CHECK(names(p) == "@f/1/3 @g/0/1 ");
+}
+
+// Errors point at the line that is wrong, not at the start of the program
+static std::string error_position(const std::string &source) {
+  try {
+    parse_string(source, "lines.L2");
+  } catch (const std::runtime_error &e) {
+    std::string what = e.what();
+    return what.substr(0, what.find(": "));
+  }
+  return "";
+}
+
+static void error_lines() {
+  L2_CHECK(error_position("(@main\n(@main\n  0\n  rax <- 1\n  rax <-- 2\n  return\n)\n)\n") == "lines.L2:5:3");
+  L2_CHECK(error_position("(@f\n  0\n  return\n)\n(@g\n  0\n  return\n") == "lines.L2:8:1");
+  L2_CHECK(error_position("(@main\n(@main\n  0\n  return\n)\nreturn\n)\n") == "lines.L2:6:1");
+}
+
+int main() {
+  whole_program();
+  lone_functions();
+  parse_string_errors();
+  error_lines();
+  return test::failures;
+}
@@ -0,0 +1,136 @@
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <test.h>
+#include <spill.h>
+
+using namespace L2;
+
+// Spills the given variables of p's first function the way one allocator round would
+static void spill_variables(Program &p, std::initializer_list<const char*> names) {
+  std::unordered_set<Symbol> spillInputs;
+  for (const char* name : names) {
+    spillInputs.insert(intern(name));
+  }
+  std::unordered_map<Symbol, Item*> constants;
+  std::unordered_map<Symbol, int64_t> splitSlots;
+  std::unordered_set<const Instruction*> crowded;
+  LoopPromotions promotions;
+  std::unordered_set<Symbol> spillTemps;
+  std::unordered_set<const Item*> slotItems;
+  std::unordered_map<Symbol, size_t> functionVariables;
+  spill(p, p.arena, spillInputs, constants, splitSlots, crowded, promotions, spillTemps, slotItems, functionVariables, 0, 0, 0);
+}
+
+static bool is_register(const Item* item, RegisterID id) {
+  return item->kind() == ItemType::RegisterItem && static_cast<const Register*>(item)->id() == id;
+}
+
+// True if item is mem rsp offset
+static bool is_slot(const Item* item, int64_t offset) {
+  if (item->kind() != ItemType::MemoryItem) {
+    return false;
+  }
+  auto* m = static_cast<const Memory*>(item);
+  return is_register(m->getVar(), RegisterID::rsp) && m->getOffset()->value() == offset;
+}
+
+// After the call nothing is cached, so the copy into rax reads the slot itself instead of going through a temporary
+static void copy_out_of_slot() {
+  auto p = parse_string(R"((@f
+(@f
+  0
+  %v <- rdi
+  rdi <- 1
+  call print 1
+  rax <- %v
+  return
+)
+)
+)", "copy_out_of_slot");
+  spill_variables(p, {"%v"});
+  auto& instructions = p.functions[0]->instructions;
+  L2_CHECK(instructions.size() >= 2);
+  auto* copy = dynamic_cast<Instruction_assignment*>(instructions[instructions.size() - 2]);
+  L2_CHECK(copy != nullptr && is_register(copy->dst(), RegisterID::rax) && is_slot(copy->src(), 0));
+}
+
+// Within a block one load of %v serves all three uses
+static void reload_serves_following_uses() {
+  auto p = parse_string(R"((@f
+(@f
+  1
+  %v <- rdi
+  rdi <- 1
+  call print 1
+  %s <- 1
+  %s += %v
+  %s += %v
+  %s *= %v
+  rax <- %s
+  return
+)
+)
+)", "reload_serves_following_uses");
+  spill_variables(p, {"%v"});
+  size_t loads = 0;
+  for (Instruction* i : p.functions[0]->instructions) {
+    auto* a = dynamic_cast<Instruction_assignment*>(i);
+    loads += a != nullptr && is_slot(a->src(), 0);
+  }
+  L2_CHECK(loads == 1);
+}
+
+// %inv and %acc are live across the calls and spill, but the loop has registers to spare:
+// both are loaded ahead of it, and %acc, which the loop defines, is stored once it exits
+static void loop_keeps_spilled_variables_in_registers() {
+  auto p = parse_string(R"((@f
+(@f
+  1
+  %inv <- rdi
+  %acc <- 0
+  rdi <- 1
+  call print 1
+  %i <- 10
+  :loop
+  %acc += %inv
+  %i -= 1
+  cjump 0 < %i :loop
+  rdi <- %acc
+  call print 1
+  rdi <- %inv
+  call print 1
+  return
+)
+)
+)", "loop_promotion");
+  std::istringstream code(test::generate(p));
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(code, line); ) {
+    lines.push_back(line);
+  }
+  size_t label = 0;
+  size_t cjump = 0;
+  for (size_t j = 0; j < lines.size(); j++) {
+    if (lines[j] == "  :loop") { label = j; }
+    if (lines[j].rfind("  cjump", 0) == 0) { cjump = j; }
+  }
+  L2_CHECK(label >= 2 && cjump > label && cjump + 1 < lines.size());
+  if (label < 2 || cjump <= label || cjump + 1 >= lines.size()) { return; }
+
+  for (size_t j = label + 1; j < cjump; j++) {
+    L2_CHECK(lines[j].find("mem rsp") == std::string::npos);
+  }
+  L2_CHECK(lines[label - 1].find("<- mem rsp") != std::string::npos);
+  L2_CHECK(lines[label - 2].find("<- mem rsp") != std::string::npos);
+  L2_CHECK(lines[cjump + 1].rfind("  mem rsp", 0) == 0);
+}
+
+int main() {
+  copy_out_of_slot();
+  reload_serves_following_uses();
+  loop_keeps_spilled_variables_in_registers();
+  return test::failures;
+}
@@ -0,0 +1,90 @@
+#include <regex>
+#include <unordered_set>
+
+#include <test.h>
+#include <cfg.h>
+#include <stack_slots.h>
+
+using namespace L2;
+
+static Instruction_assignment* assignment(Function &f, size_t j) {
+  return static_cast<Instruction_assignment*>(f.instructions[j]);
+}
+
+static int64_t offset(const Item* mem) {
+  return static_cast<const Memory*>(mem)->getOffset()->value();
+}
+
+// The program's own mem rsp 0 is not a slot: it keeps its word, and the two slots that
+// take turns share the next one instead of moving onto it
+static void program_access_keeps_its_word() {
+  auto p = parse_string(R"((@f
+(@f
+  0
+  mem rsp 0 <- 7
+  mem rsp 0 <- rdi
+  rdi <- mem rsp 0
+  mem rsp 8 <- rdi
+  rdi <- mem rsp 8
+  rax <- mem rsp 0
+  return
+)
+)
+)", "program_access");
+  Function &f = *p.functions[0];
+  Item* own[] = {assignment(f, 0)->dst(), assignment(f, 5)->src()};
+  std::unordered_set<const Item*> slotItems = {assignment(f, 1)->dst(), assignment(f, 2)->src(), assignment(f, 3)->dst(), assignment(f, 4)->src()};
+
+  L2_CHECK(color_stack_slots(f, build_cfg(f), p.arena, 2, slotItems) == 2);
+  L2_CHECK(assignment(f, 0)->dst() == own[0] && assignment(f, 5)->src() == own[1]);
+  L2_CHECK(offset(assignment(f, 1)->dst()) == 8 && offset(assignment(f, 2)->src()) == 8);
+  L2_CHECK(offset(assignment(f, 3)->dst()) == 8 && offset(assignment(f, 4)->src()) == 8);
+}
+
+// Nothing stores to these slots before they are read, so they can't share a word
+static void entry_slots_stay_apart() {
+  auto p = parse_string(R"((@f
+(@f
+  0
+  rdi <- mem rsp 0
+  rsi <- mem rsp 8
+  return
+)
+)
+)", "entry_slots");
+  Function &f = *p.functions[0];
+  std::unordered_set<const Item*> slotItems = {assignment(f, 0)->src(), assignment(f, 1)->src()};
+
+  L2_CHECK(color_stack_slots(f, build_cfg(f), p.arena, 2, slotItems) == 2);
+  L2_CHECK(offset(assignment(f, 0)->src()) != offset(assignment(f, 1)->src()));
+}
+
+// Spilling twelve values around a call next to the program's own mem rsp 0 leaves that word to the program
+static void spills_next_to_program_access() {
+  std::string source = "(@f\n(@f\n0\n  mem rsp 0 <- 7\n";
+  for (int k = 0; k < 12; k++) {
+    source += "  %v" + std::to_string(k) + " <- rdi\n  %v" + std::to_string(k) + " += " + std::to_string(k) + "\n";
+  }
+  source += "  rdi <- 1\n  call print 1\n  rax <- mem rsp 0\n";
+  for (int k = 0; k < 12; k++) {
+    source += "  rax += %v" + std::to_string(k) + "\n";
+  }
+  source += "  return\n)\n)\n";
+  auto p = parse_string(source, "spills_next_to_program_access");
+  std::string code = test::generate(p);
+
+  std::smatch header;
+  L2_CHECK(std::regex_search(code, header, std::regex("\\(@f\\n0 (\\d+)\\n")));
+  long locals = header.empty() ? 0 : std::stol(header[1]);
+  L2_CHECK(locals > 1);
+
+  const std::regex wordZero("mem rsp 0\\b");
+  L2_CHECK(std::distance(std::sregex_iterator(code.begin(), code.end(), wordZero), std::sregex_iterator()) == 2);
+}
+
+int main() {
+  program_access_keeps_its_word();
+  entry_slots_stay_apart();
+  spills_next_to_program_access();
+  return test::failures;
+}
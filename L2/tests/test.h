@@ -0,0 +1,35 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <L2.h>
+#include <parser.h>
+#include <liveness_analysis.h>
+#include <code_generator.h>
+
+// Checks shared by the tests in this directory; a test's main returns L2::test::failures
+#define L2_CHECK(condition) \
+  ::L2::test::check((condition), #condition, __FILE__, __LINE__)
+
+namespace L2::test {
+
+  inline int failures = 0;
+
+  inline void check(bool ok, const char* what, const char* file, int line) {
+    if (!ok) {
+      std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+      failures++;
+    }
+  }
+
+  // Allocates registers for p and returns the L1 program -g would write to prog.L1
+  inline std::string generate(Program &p, size_t jobs = 1) {
+    auto allocations = analyze_liveness(p, false, false, jobs);
+    std::ostringstream out;
+    CodeGenBehavior b(out, allocations);
+    p.accept(b);
+    return out.str();
+  }
+}